@@ -0,0 +1,26 @@
+#!/bin/sh
+# Compares the row-major (solvemaze) and tiled (solvemaze-tiled) node layouts
+# on mazes whose rows of nodes do not fit in the L2 cache, printing the best
+# solve time of RUNS runs of each.
+# Usage: bench/layout.sh [RUNS]
+
+runs=${1:-3}
+dir=${TMPDIR:-/tmp}/mazebench.$$
+mkdir -p "$dir" || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+best(){
+	for r in $(seq "$runs"); do
+		"$@" 2>&1 >/dev/null | grep "Time to solve"
+	done | awk '{ t = $NF; if(min == "" || t < min) min = t } END { print min }'
+}
+
+printf "%-15s %12s %12s\n" "maze" "row-major" "tiled"
+for shape in "200000 60" "60000 600" "5000 5000"; do
+	w=${shape% *}
+	h=${shape#* }
+	./genmaze -s 1 "$dir/maze.txt" dfs "$w" "$h" 8 >/dev/null 2>&1 || exit 1
+	printf "%-15s %12s %12s\n" "${w}x${h}" \
+		"$(best ./solvemaze "$dir/maze.txt")" \
+		"$(best ./solvemaze-tiled "$dir/maze.txt")"
+done
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Starts solvemaze --serve on two seeded mazes and loads it with mazeclient,
+# printing the throughput and client latencies for several numbers of
+# clients and depths of pipelining, then the server's own histogram.
+# Usage: bench/serve.sh [REQUESTS]
+#   REQUESTS per client (default: 500). SOLVEFLAGS in the environment go to
+#   the server, such as -j to set its number of workers.
+
+reqs=${1:-500}
+dir=${TMPDIR:-/tmp}/mazebench.$$
+mkdir -p "$dir" || exit 1
+sock=$dir/serve.sock
+pid=
+trap '[ -n "$pid" ] && kill $pid 2>/dev/null; rm -rf "$dir"' EXIT
+
+./genmaze -s 1 "$dir/rand.txt" rand 3000 3000 240 >/dev/null 2>&1 || exit 1
+./genmaze -s 1 "$dir/dfs.txt"  dfs  1000 1000 8   >/dev/null 2>&1 || exit 1
+./solvemaze $SOLVEFLAGS --serve="$sock" "$dir/rand.txt" "$dir/dfs.txt" 2>"$dir/server.log" &
+pid=$!
+while [ ! -S "$sock" ]; do
+	kill -0 $pid 2>/dev/null || { cat "$dir/server.log" >&2; exit 1; }
+	sleep 0.1
+done
+
+printf "%-6s %-8s %-9s %12s %10s %10s %10s\n" "maze" "clients" "pipeline" "requests/s" "p50 us" "p99 us" "max us"
+for maze in 0 1; do
+	for c in 1 4; do
+		for p in 1 8; do
+			./mazeclient -n "$reqs" -c "$c" -p "$p" -m "$maze" "$sock" 2>/dev/null | awk -v m="$maze" -v c="$c" -v p="$p" '
+				/^Requests\/second/ { rps = $NF }
+				/^Latency/          { p50 = $6; p99 = $10; max = $14 }
+				END { printf "%-6s %-8s %-9s %12s %10s %10s %10s\n", m, c, p, rps, p50, p99, max }'
+		done
+	done
+done
+./mazeclient "$sock" <<END
+stats
+END
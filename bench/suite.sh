@@ -0,0 +1,123 @@
+#!/bin/sh
+# Runs solvemaze on a fixed matrix of seeded mazes, rand and dfs of several
+# sizes and odds of extra connections, RUNS times each, and prints a CSV line
+# per maze with its path length, node counts and the best time of each phase
+# across the runs. With a BASELINE, a CSV of an earlier run, each phase that
+# got more than TOLERANCE percent (and a millisecond) slower is flagged, as
+# is any maze whose length or counts changed, and the exit status is 1 if
+# anything was flagged. Run from the top of the tree, as make bench does.
+# Usage: bench/suite.sh [-r RUNS] [-b BASELINE] [-t TOLERANCE] [-o OUTPUT]
+#   SOLVEMAZE and SOLVEFLAGS in the environment select the binary and the
+#   flags to benchmark (default: ./solvemaze with none).
+
+runs=3
+baseline=
+tolerance=10
+output=
+while getopts r:b:t:o: opt; do
+	case $opt in
+		r) runs=$OPTARG ;;
+		b) baseline=$OPTARG ;;
+		t) tolerance=$OPTARG ;;
+		o) output=$OPTARG ;;
+		*) sed -n 's/^# Usage: /Usage: /p' "$0" >&2; exit 2 ;;
+	esac
+done
+solver=${SOLVEMAZE:-./solvemaze}
+case $solver in
+	/*) ;;
+	*)  solver=$PWD/$solver ;;
+esac
+if [ -n "$baseline" ] && [ ! -r "$baseline" ]; then
+	echo "Cannot read baseline $baseline." >&2
+	exit 2
+fi
+
+dir=${TMPDIR:-/tmp}/mazebench.$$
+mkdir -p "$dir" || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+cols="maze,algorithm,width,height,odds,runs,length,expansions,pushes"
+cols="$cols,dimensions,allocate,parse,prepare,init,solve,display,total"
+
+# Turns the stderr of one run into its CSV fields from length on. Phases a
+# run does not have, such as the preparation of -d, -G, -H or -B, are 0.
+fields(){
+	awk -F: '
+		/^Solved \(length/  { sub(/.*length /, ""); sub(/\).*/, ""); len = $0 }
+		/^No path exists/   { len = -1 }
+		/^Expansions /      { nexp = $2 + 0 }
+		/^Queue pushes /    { push = $2 + 0 }
+		/^Time to / {
+			name = $1; sub(/^Time to /, "", name); sub(/ *$/, "", name)
+			t[name] = $2 + 0
+		}
+		END {
+			prep = t["fill dead ends"] + t["contract maze"] + t["build clusters"] + t["build bitboards"]
+			printf "%s,%s,%s,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f\n",
+			       len, nexp + 0, push + 0, t["get dimensions"], t["allocate memory"],
+			       t["parse file"], prep, t["init the heap"], t["solve the maze"],
+			       t["display results"], t["do everything"]
+		}'
+}
+
+# Runs the solver RUNS times on maze $1 and prints the fields of the first
+# run with each time replaced by its best.
+best(){
+	for r in $(seq "$runs"); do
+		(cd "$dir" && $solver $SOLVEFLAGS "$1") 2>&1 >/dev/null | fields
+	done | awk -F, -v OFS=, '
+		NR == 1 { for(i = 1; i <= NF; i++) b[i] = $i; n = NF; next }
+		        { for(i = 4; i <= n; i++) if($i < b[i]) b[i] = $i }
+		END     { for(i = 1; i <= n; i++) printf "%s%s", b[i], i < n ? OFS : "\n" }'
+}
+
+{
+	echo "$cols"
+	for maze in "rand 1000 220" "rand 1000 240" "rand 1000 255" \
+	            "rand 3000 220" "rand 3000 240" "rand 3000 255" \
+	            "dfs 1000 0"   "dfs 1000 8"    "dfs 1000 64"   \
+	            "dfs 3000 0"   "dfs 3000 8"    "dfs 3000 64"; do
+		set -- $maze
+		./genmaze -s 1 "$dir/maze.txt" "$1" "$2" "$2" "$3" >/dev/null 2>&1 || exit 1
+		echo "$1-$2x$2-$3,$1,$2,$2,$3,$runs,$(best "$dir/maze.txt")"
+	done
+} > "$dir/out.csv" || exit 1
+
+if [ -n "$output" ]; then
+	cp "$dir/out.csv" "$output" || exit 1
+fi
+if [ -z "$baseline" ]; then
+	cat "$dir/out.csv"
+	exit 0
+fi
+
+# Compares against the baseline, maze by maze and column by column, and
+# prints the current CSV with a status column saying what got worse.
+awk -F, -v OFS=, -v tol="$tolerance" '
+	FNR == NR { if(FNR > 1) base[$1] = $0; next }
+	FNR == 1  { for(i = 1; i <= NF; i++) col[i] = $i; print $0, "status"; next }
+	{
+		status = ""
+		if(!($1 in base)){
+			print $0, "new"
+			next
+		}
+		split(base[$1], b, ",")
+		for(i = 7; i <= 9; i++){
+			if($i != b[i]){
+				status = status " " col[i] "-changed"
+			}
+		}
+		for(i = 10; i <= NF; i++){
+			if($i > b[i] * (1 + tol / 100) && $i - b[i] > 0.001){
+				status = status sprintf(" %s+%.0f%%", col[i], ($i / b[i] - 1) * 100)
+			}
+		}
+		sub(/^ /, "", status)
+		if(status != ""){
+			bad++
+		}
+		print $0, status == "" ? "ok" : status
+	}
+	END { exit bad > 0 }' "$baseline" "$dir/out.csv"
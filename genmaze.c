@@ -3,28 +3,116 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Packed binary maze format, version 1. All integers are little-endian.
+//   bytes  0- 3: magic "MAZB"
+//   bytes  4- 7: format version
+//   bytes  8-11: width  (mx)
+//   bytes 12-15: height (my)
+// followed by my rows of (mx + 3) / 4 bytes. Cell j of a row is stored in
+// the two bits starting at bit 2 * (j % 4) of byte j / 4: the low bit is set
+// if the cell is open to the right, the high bit if it is open downwards.
+// Openings off the edge of the maze are always written as 0.
+#define MAZB_MAGIC   "MAZB"
+#define MAZB_VERSION 1
+#define MAZB_HDRLEN  16
 
 int mx;
 int my;
 char **maze;
-FILE *rf;
 FILE *of;
 
+// Random bits come from xoshiro256**, seeded through splitmix64 from --seed
+// or, failing that, from a single read of /dev/urandom. The same seed and
+// arguments always give the same maze.
+typedef struct _rng {
+	uint64_t s[4];   // Generator state
+	uint64_t word;   // Bits not handed out yet
+	int      left;   // Number of them
+} rng;
+
+rng gr;           // Stream of the serial generators
+uint64_t seed;
+
+// random_connections() works on fixed bands of RBAND rows. Band k draws from
+// its own stream, the seeded state advanced by k + 1 jumps of 2^128 steps, so
+// the maze does not depend on how many threads share out the bands.
+#define RBAND 64
+rng *brng;        // One stream per band
+int nbands;
+int nextband;     // Next band to hand out, taken with __sync_fetch_and_add
+int nthreads;
+
 int odds;
+int binary;
 
 void random_connections(void);
 void depth_first(void);
+void eller(void);
 
 void alloc_maze(void);
 void print_maze(void);
+void emit_header(void);
+void emit_row(char *row, int i);
 int randdir(int opts);
 
+void run_bands(void *(*fn)(void *));
+void *band_bits(void *arg);
+void *band_mirror(void *arg);
+
+void     seed_rng(rng *r, uint64_t s);
+uint64_t rng_next(rng *r);
+void     rng_jump(rng *r);
+unsigned int rand_bits(rng *r, int n);
+
 int main(int argc, char *argv[]){
+	static struct option lopts[] = {
+		{"binary", no_argument, NULL, 'b'},
+		{"seed", required_argument, NULL, 's'},
+		{"threads", required_argument, NULL, 'j'},
+		{NULL, 0, NULL, 0}
+	};
+	int opt;
+	int seeded = 0;
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	while((opt = getopt_long(argc, argv, "bs:j:", lopts, NULL)) != -1){
+		switch(opt){
+			case 'b':
+				binary = 1;
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 0);
+				seeded = 1;
+				break;
+			case 'j':
+				nthreads = atoi(optarg);
+				break;
+			default:
+				return 1;
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
 	if(argc != 5 && argc != 6){
-		printf("Usage: ./genmaze OUTPUT_FILE ALGORITHM WIDTH HEIGHT [RANDOMNESS]\n"
+		printf("Usage: ./genmaze [OPTIONS] OUTPUT_FILE ALGORITHM WIDTH HEIGHT [RANDOMNESS]\n"
+		       "\n"
+		       "ALGORITHM: rand OR dfs OR eller\n"
+		       "  eller generates one row at a time in memory proportional to\n"
+		       "  WIDTH, writing each row out as soon as it is done.\n"
+		       "RANDOMNESS: odds of adding a(n extra, for dfs) connection, out of 256\n"
 		       "\n"
-		       "ALGORITHM: rand OR dfs\n"
-		       "RANDOMNESS: odds of adding a(n extra, for dfs) connection, out of 256\n\n");
+		       "OPTIONS:\n"
+		       "  -b, --binary  write the packed binary format (2 bits per cell)\n"
+		       "                instead of text\n"
+		       "  -s, --seed=N  seed the random generator with N, to make the\n"
+		       "                same maze again (default: from /dev/urandom)\n"
+		       "  -j, --threads=N  number of threads adding the random connections\n"
+		       "                of rand and dfs (default: one per CPU); the maze\n"
+		       "                is the same for any N\n\n");
 		return 0;
 	}
 	if(!strcmp(argv[1], "-")){
@@ -43,18 +131,36 @@ int main(int argc, char *argv[]){
 			odds = 0;
 		}
 	}
-	rf = fopen("/dev/urandom", "r");
+	if(!seeded){
+		FILE *rf = fopen("/dev/urandom", "r");
+		if(rf == NULL || fread(&seed, sizeof(seed), 1, rf) != 1){
+			fprintf(stderr, "Could not read a seed from /dev/urandom.\n");
+			return 1;
+		}
+		fclose(rf);
+	}
+	fprintf(stderr, "Seed: %llu\n", (unsigned long long) seed);
+	seed_rng(&gr, seed);
+	if(nthreads < 1){
+		nthreads = 1;
+	}
+	if(!strcmp(argv[2], "eller")){
+		fprintf(stderr, "Generating and printing...\n");
+		eller();
+		fprintf(stderr, "Done.\n");
+		return 0;
+	}
+	if(strcmp(argv[2], "rand") && strcmp(argv[2], "dfs")){
+		printf("Invalid algorithm.\n");
+		return 0;
+	}
 	fprintf(stderr, "Allocating...\n");
 	alloc_maze();
 	fprintf(stderr, "Generating...\n");
 	if(!strcmp(argv[2], "rand")){
 		random_connections();
-	} else
-	if(!strcmp(argv[2], "dfs")){
-		depth_first();
 	} else {
-		printf("Invalid algorithm.\n");
-		return 0;
+		depth_first();
 	}
 	fprintf(stderr, "Printing...\n");
 	print_maze();
@@ -123,18 +229,76 @@ void depth_first(void){
 }
 
 void random_connections(void){
-	int i, j;
-	for(i = 0; i < my; i++){
-		for(j = 0; j < mx; j++){
-			maze[i][j] |= (fgetc(rf) < odds) * 2 + (fgetc(rf) < odds);
-			if(j < mx - 1 && (maze[i][j] & 1)){
-				maze[i][j + 1] |= 4;
+	rng r;
+	int k;
+	seed_rng(&r, seed);
+	nbands = (my + RBAND - 1) / RBAND;
+	brng = malloc(nbands * sizeof(rng));
+	if(brng == NULL){
+		fprintf(stderr, "Malloc failed.\n");
+		exit(1);
+	}
+	for(k = 0; k < nbands; k++){
+		rng_jump(&r);
+		brng[k] = r;
+	}
+	// Each band first sets the right and down bits of its own cells, then,
+	// once every band is done, the left and up bits of its own cells from
+	// its neighbours. Nothing is written outside a band's rows.
+	run_bands(band_bits);
+	run_bands(band_mirror);
+	free(brng);
+}
+
+// Runs fn on nthreads threads (the calling one included) until every band
+// has been taken.
+void run_bands(void *(*fn)(void *)){
+	pthread_t *th = malloc(nthreads * sizeof(pthread_t));
+	int t, nt = 0;
+	nextband = 0;
+	for(t = 1; th != NULL && t < nthreads && t < nbands; t++){
+		if(pthread_create(&th[nt], NULL, fn, NULL)){
+			break;
+		}
+		nt++;
+	}
+	fn(NULL);
+	for(t = 0; t < nt; t++){
+		pthread_join(th[t], NULL);
+	}
+	free(th);
+}
+
+void *band_bits(void *arg){
+	int i, j, k;
+	(void) arg;
+	while((k = __sync_fetch_and_add(&nextband, 1)) < nbands){
+		rng *r = &brng[k];
+		for(i = k * RBAND; i < my && i < (k + 1) * RBAND; i++){
+			for(j = 0; j < mx; j++){
+				maze[i][j] |= (rand_bits(r, 8) < (unsigned) odds) * 2 + (rand_bits(r, 8) < (unsigned) odds);
 			}
-			if(i < my - 1 && (maze[i][j] & 2)){
-				maze[i + 1][j] |= 8;
+		}
+	}
+	return NULL;
+}
+
+void *band_mirror(void *arg){
+	int i, j, k;
+	(void) arg;
+	while((k = __sync_fetch_and_add(&nextband, 1)) < nbands){
+		for(i = k * RBAND; i < my && i < (k + 1) * RBAND; i++){
+			for(j = 0; j < mx; j++){
+				if(j > 0 && (maze[i][j - 1] & 1)){
+					maze[i][j] |= 4;
+				}
+				if(i > 0 && (maze[i - 1][j] & 2)){
+					maze[i][j] |= 8;
+				}
 			}
 		}
 	}
+	return NULL;
 }
 
 void alloc_maze(void){
@@ -149,39 +313,179 @@ void alloc_maze(void){
 	}
 }
 
-void print_maze(void){
-	int i, j;
-	fprintf(of, "%d %d\n", my, mx);
-	for(i = 0; i < my - 1; i++){
+// Eller's algorithm: builds a perfect maze one row at a time, keeping only
+// which cells of the current row are already connected to each other
+// (through rows above) as a set label per cell. Adjacent cells in different
+// sets are joined at random, then every set gets at least one passage down
+// and the cells below those passages inherit the set; the rest start sets
+// of their own. The last row joins everything that is still apart. Labels
+// are merged through a union-find over at most mx labels, renumbered after
+// every row, so memory stays proportional to the width.
+// Extra connections (RANDOMNESS) are added to the written rows only, the set
+// bookkeeping never sees them.
+void eller(void){
+	int *set   = malloc(mx * sizeof(int)); // Set label of each cell
+	int *uf    = malloc(mx * sizeof(int)); // Union-find parent of each label
+	int *left  = malloc(mx * sizeof(int)); // Cells of a set not yet done
+	int *relab = malloc(mx * sizeof(int)); // New label of each label
+	char *has  = malloc(mx);               // Set already has a passage down
+	char *down = malloc(mx);               // Passage down (perfect maze)
+	char *row  = malloc(mx);               // Row as written
+	int i, j, a, b, nl;
+	if(set == NULL || uf == NULL || left == NULL || relab == NULL ||
+	   has == NULL || down == NULL || row == NULL){
+		fprintf(stderr, "Row malloc() failed.\n");
+		return;
+	}
+	for(j = 0; j < mx; j++){
+		set[j] = j;
+	}
+	nl = mx;
+	emit_header();
+	for(i = 0; i < my; i++){
+		for(a = 0; a < nl; a++){
+			uf[a] = a;
+		}
+		memset(row, 0, mx);
 		for(j = 0; j < mx - 1; j++){
-			if(maze[i][j] & 1){
-				fprintf(of, "O . ");
-			} else {
-				fprintf(of, "O | ");
+			for(a = set[j    ]; uf[a] != a; a = uf[a] = uf[uf[a]]);
+			for(b = set[j + 1]; uf[b] != b; b = uf[b] = uf[uf[b]]);
+			if(a != b && (i == my - 1 || rand_bits(&gr, 1))){
+				uf[b] = a;
+				row[j] |= 1;
 			}
 		}
-		fprintf(of, "O\n");
-		for(j = 0; j < mx - 1; j++){
-			if(maze[i][j] & 2){
-				fprintf(of, ".   ");
-			} else {
-				fprintf(of, "-   ");
+		if(i < my - 1){
+			for(a = 0; a < nl; a++){
+				left[a] = 0;
+				has[a] = 0;
+			}
+			for(j = 0; j < mx; j++){
+				for(a = set[j]; uf[a] != a; a = uf[a] = uf[uf[a]]);
+				set[j] = a;
+				left[a]++;
+			}
+			for(j = 0; j < mx; j++){
+				a = set[j];
+				down[j] = rand_bits(&gr, 1) || (left[a] == 1 && !has[a]);
+				has[a] |= down[j];
+				left[a]--;
+				if(down[j]){
+					row[j] |= 2;
+				}
+			}
+			// Renumber: cells below a passage keep their set under a new
+			// compact label, the others get a fresh label each.
+			for(a = 0; a < nl; a++){
+				relab[a] = -1;
+			}
+			nl = 0;
+			for(j = 0; j < mx; j++){
+				if(down[j]){
+					if(relab[set[j]] < 0){
+						relab[set[j]] = nl++;
+					}
+					set[j] = relab[set[j]];
+				} else {
+					set[j] = -1;
+				}
+			}
+			for(j = 0; j < mx; j++){
+				if(set[j] < 0){
+					set[j] = nl++;
+				}
 			}
 		}
-		if(maze[i][j] & 2){
-			fprintf(of, ".\n");
-		} else {
-			fprintf(of, "-\n");
+		if(odds){
+			for(j = 0; j < mx; j++){
+				row[j] |= (rand_bits(&gr, 8) < (unsigned) odds) * 2 + (rand_bits(&gr, 8) < (unsigned) odds);
+			}
 		}
+		emit_row(row, i);
 	}
-	for(j = 0; j < mx - 1; j++){
-		if(maze[i][j] & 1){
-			fprintf(of, "O . ");
-		} else {
-			fprintf(of, "O | ");
+	free(set);
+	free(uf);
+	free(left);
+	free(relab);
+	free(has);
+	free(down);
+	free(row);
+}
+
+void print_maze(void){
+	int i;
+	emit_header();
+	for(i = 0; i < my; i++){
+		emit_row(maze[i], i);
+	}
+}
+
+void emit_header(void){
+	if(binary){
+		unsigned char hdr[MAZB_HDRLEN];
+		unsigned int hv[3] = {MAZB_VERSION, mx, my};
+		int k;
+		memcpy(hdr, MAZB_MAGIC, 4);
+		for(k = 0; k < 3; k++){
+			hdr[4 * k + 4] = hv[k];
+			hdr[4 * k + 5] = hv[k] >> 8;
+			hdr[4 * k + 6] = hv[k] >> 16;
+			hdr[4 * k + 7] = hv[k] >> 24;
 		}
+		fwrite(hdr, 1, MAZB_HDRLEN, of);
+	} else {
+		fprintf(of, "%d %d\n", my, mx);
 	}
-	fprintf(of, "O\n");
+}
+
+// Writes row i (bit 1: open to the right, bit 2: open downwards) in the
+// output format. Text rows are assembled in a line buffer and written with
+// one fwrite() per line; openings off the edge of the maze are dropped.
+void emit_row(char *row, int i){
+	static char *lbuf = NULL;
+	int j, k;
+	if(binary){
+		int rl = (mx + 3) / 4;
+		unsigned char *rbuf;
+		if(lbuf == NULL){
+			lbuf = malloc(rl);
+		}
+		rbuf = (unsigned char *) lbuf;
+		memset(rbuf, 0, rl);
+		for(j = 0; j < mx; j++){
+			k = row[j] & 3;
+			if(j == mx - 1){
+				k &= ~1;
+			}
+			if(i == my - 1){
+				k &= ~2;
+			}
+			rbuf[j >> 2] |= k << (2 * (j & 3));
+		}
+		fwrite(rbuf, 1, rl, of);
+		return;
+	}
+	char *p;
+	if(lbuf == NULL){
+		lbuf = malloc(4 * mx - 2);
+	}
+	p = lbuf;
+	for(j = 0; j < mx - 1; j++){
+		memcpy(p, (row[j] & 1) ? "O . " : "O | ", 4);
+		p += 4;
+	}
+	memcpy(p, "O\n", 2);
+	fwrite(lbuf, 1, 4 * mx - 2, of);
+	if(i == my - 1){
+		return;
+	}
+	p = lbuf;
+	for(j = 0; j < mx - 1; j++){
+		memcpy(p, (row[j] & 2) ? ".   " : "-   ", 4);
+		p += 4;
+	}
+	memcpy(p, (row[j] & 2) ? ".\n" : "-\n", 2);
+	fwrite(lbuf, 1, 4 * mx - 2, of);
 }
 
 int randdir(int opts){
@@ -191,7 +495,7 @@ int randdir(int opts){
 	                      1,2,2,3,
 	                      1,2,2,3,
 	                      2,3,3,4};
-	unsigned int rb = fgetc(rf);
+	unsigned int rb;
 	switch(bitcounts[opts]){
 		case 0:
 			//fprintf(stderr, "NO NEIGHBORS TO SUPPOSEDLY OPEN CELL!\n");
@@ -200,7 +504,7 @@ int randdir(int opts){
 			dir = opts;
 			break;
 		case 2:
-			if(rb & 1){
+			if(rand_bits(&gr, 1)){
 				if(opts & 1){
 					if(opts & 2){
 						dir = 2;
@@ -232,9 +536,7 @@ int randdir(int opts){
 			}
 			break;
 		case 3:
-			while(rb == 0xFF){
-				rb = fgetc(rf);
-			}
+			while((rb = rand_bits(&gr, 2)) == 3);
 			if(~opts & 1){
 				dir = 2 << (rb % 3);
 			} else
@@ -270,3 +572,70 @@ int randdir(int opts){
 	}
 	return dir;
 }
+
+static uint64_t splitmix64(uint64_t *x){
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void seed_rng(rng *r, uint64_t s){
+	int k;
+	for(k = 0; k < 4; k++){
+		r->s[k] = splitmix64(&s);
+	}
+	r->left = 0;
+}
+
+#define rotl(X,K) (((X) << (K)) | ((X) >> (64 - (K))))
+
+uint64_t rng_next(rng *r){
+	uint64_t *rs = r->s;
+	uint64_t x = rotl(rs[1] * 5, 7) * 9;
+	uint64_t t = rs[1] << 17;
+	rs[2] ^= rs[0];
+	rs[3] ^= rs[1];
+	rs[1] ^= rs[2];
+	rs[0] ^= rs[3];
+	rs[2] ^= t;
+	rs[3] = rotl(rs[3], 45);
+	return x;
+}
+
+// Advances the generator by 2^128 steps, giving a stream that will not run
+// into the one it was taken from.
+void rng_jump(rng *r){
+	static const uint64_t jump[] = {
+		0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+		0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+	};
+	uint64_t t[4] = {0, 0, 0, 0};
+	int i, b, k;
+	for(i = 0; i < 4; i++){
+		for(b = 0; b < 64; b++){
+			if(jump[i] & (1ULL << b)){
+				for(k = 0; k < 4; k++){
+					t[k] ^= r->s[k];
+				}
+			}
+			rng_next(r);
+		}
+	}
+	memcpy(r->s, t, sizeof(t));
+	r->left = 0;
+}
+
+// Hands out the next n (at most 32) bits of the buffered word, drawing a new
+// word once it runs dry.
+unsigned int rand_bits(rng *r, int n){
+	unsigned int x;
+	if(r->left < n){
+		r->word = rng_next(r);
+		r->left = 64;
+	}
+	x = r->word & ((1ULL << n) - 1);
+	r->word >>= n;
+	r->left -= n;
+	return x;
+}
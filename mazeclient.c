@@ -0,0 +1,324 @@
+// Client of solvemaze --serve. Without -n it passes the request lines of
+// stdin to the server and prints its replies; with -n it is a load
+// generator, which has each of -c clients send -n random path queries over
+// a connection of its own and reports the throughput and the latencies the
+// clients saw, then the server's own statistics.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+char *sfn;
+int nclients = 1;
+long long int nreq;
+int maze;
+int depth = 1;
+int paths;
+uint64_t seed = 1;
+
+int mx;
+int my;
+
+// A client of the load generator. lat has the latency of each of its
+// requests in nanoseconds.
+typedef struct _client {
+	pthread_t tid;
+	int       id;
+	double   *lat;
+	long long int solved;
+	int       err;
+} client;
+
+int  connect_server(void);
+int  passthrough(int fd);
+int  maze_size(int fd);
+int  load(void);
+void *run_client(void *arg);
+uint64_t splitmix64(uint64_t *s);
+double now(void);
+int  cmp_double(const void *a, const void *b);
+
+int main(int argc, char *argv[]){
+	static struct option lopts[] = {
+		{"requests", required_argument, NULL, 'n'},
+		{"clients", required_argument, NULL, 'c'},
+		{"maze", required_argument, NULL, 'm'},
+		{"pipeline", required_argument, NULL, 'p'},
+		{"path", no_argument, NULL, 'P'},
+		{"seed", required_argument, NULL, 's'},
+		{NULL, 0, NULL, 0}
+	};
+	int opt;
+	while((opt = getopt_long(argc, argv, "n:c:m:p:Ps:", lopts, NULL)) != -1){
+		switch(opt){
+			case 'n':
+				nreq = atoll(optarg);
+				break;
+			case 'c':
+				nclients = atoi(optarg);
+				break;
+			case 'm':
+				maze = atoi(optarg);
+				break;
+			case 'p':
+				depth = atoi(optarg);
+				break;
+			case 'P':
+				paths = 1;
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 0);
+				break;
+			default:
+				return 1;
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if(argc != 2 || nreq < 0 || nclients < 1 || depth < 1){
+		printf("Usage: ./mazeclient [OPTIONS] SOCKET\n"
+		       "\n"
+		       "Sends the request lines of stdin to solvemaze --serve=SOCKET\n"
+		       "and prints the replies, or with -n generates the requests.\n"
+		       "\n"
+		       "OPTIONS:\n"
+		       "  -n, --requests=N  send N random queries per client and report\n"
+		       "                    the throughput and latencies\n"
+		       "  -c, --clients=N   with -n, N clients at once, each on its own\n"
+		       "                    connection (default: 1)\n"
+		       "  -m, --maze=INDEX  query maze INDEX of the server (default: 0)\n"
+		       "  -p, --pipeline=N  keep up to N requests of a client in flight\n"
+		       "                    (default: 1)\n"
+		       "  -P, --path        ask for the steps of each path as well\n"
+		       "  -s, --seed=N      seed of the random queries (default: 1)\n\n");
+		return 1;
+	}
+	sfn = argv[1];
+	if(!nreq){
+		int fd = connect_server();
+		return fd < 0 ? 1 : passthrough(fd);
+	}
+	return load();
+}
+
+int connect_server(void){
+	struct sockaddr_un sa;
+	int fd;
+	if(strlen(sfn) >= sizeof(sa.sun_path)){
+		fprintf(stderr, "Socket path '%s' is too long.\n", sfn);
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, sfn);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (struct sockaddr *) &sa, sizeof(sa))){
+		fprintf(stderr, "Connecting to '%s' failed (%m).\n", sfn);
+		if(fd >= 0){
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+// Copies stdin to the socket, on a thread of its own so that the server's
+// replies never have to wait for the requests to be sent.
+static void *send_stdin(void *arg){
+	int fd = *(int *) arg;
+	char b[65536];
+	size_t n, o;
+	ssize_t r;
+	while((n = fread(b, 1, sizeof(b), stdin)) > 0){
+		for(o = 0; o < n; o += r){
+			r = write(fd, b + o, n - o);
+			if(r < 0){
+				return NULL;
+			}
+		}
+	}
+	shutdown(fd, SHUT_WR);
+	return NULL;
+}
+
+int passthrough(int fd){
+	pthread_t tid;
+	char b[65536];
+	ssize_t r;
+	if(pthread_create(&tid, NULL, send_stdin, &fd)){
+		fprintf(stderr, "pthread_create() failed.\n");
+		return 1;
+	}
+	while((r = read(fd, b, sizeof(b))) > 0){
+		fwrite(b, 1, r, stdout);
+	}
+	pthread_join(tid, NULL);
+	close(fd);
+	return 0;
+}
+
+// Asks the server for the size of maze number maze.
+int maze_size(int fd){
+	FILE *f = fdopen(dup(fd), "r");
+	char *line = NULL, *p;
+	size_t len = 0;
+	int i, w, h, n;
+	if(f == NULL || write(fd, "mazes\n", 6) != 6 || getline(&line, &len, f) < 0){
+		fprintf(stderr, "Asking for the mazes failed.\n");
+		return 1;
+	}
+	fclose(f);
+	for(p = line; sscanf(p, "%d %*s %d %d%n", &i, &w, &h, &n) == 3; p += strspn(p, "; ")){
+		if(i == maze){
+			mx = w;
+			my = h;
+			free(line);
+			return 0;
+		}
+		p += n;
+	}
+	fprintf(stderr, "The server has no maze %d.\n", maze);
+	free(line);
+	return 1;
+}
+
+int load(void){
+	client *c = calloc(nclients, sizeof(client));
+	double t0, t1, *all, sum = 0;
+	long long int i, k, n = (long long int) nclients * nreq, solved = 0;
+	int fd, err = 0;
+	FILE *f;
+	char *line = NULL;
+	size_t len = 0;
+	all = malloc(n * sizeof(double));
+	if(c == NULL || all == NULL){
+		fprintf(stderr, "Client malloc() failed.\n");
+		return 1;
+	}
+	fd = connect_server();
+	if(fd < 0 || maze_size(fd)){
+		return 1;
+	}
+	fprintf(stderr, "Sending %lld queries of maze %d (%d x %d) from %d clients...\n",
+	        n, maze, mx, my, nclients);
+	t0 = now();
+	for(i = 0; i < nclients; i++){
+		c[i].id = i;
+		if(pthread_create(&c[i].tid, NULL, run_client, &c[i])){
+			fprintf(stderr, "pthread_create() failed for client %lld.\n", i);
+			return 1;
+		}
+	}
+	for(i = 0; i < nclients; i++){
+		pthread_join(c[i].tid, NULL);
+		err |= c[i].err;
+	}
+	t1 = now();
+	if(err){
+		return 1;
+	}
+	for(i = 0, k = 0; i < nclients; i++){
+		memcpy(all + k, c[i].lat, nreq * sizeof(double));
+		k += nreq;
+		solved += c[i].solved;
+		free(c[i].lat);
+	}
+	for(i = 0; i < n; i++){
+		sum += all[i];
+	}
+	qsort(all, n, sizeof(double), cmp_double);
+	printf("Requests       : %lld (%lld solved)\n", n, solved);
+	printf("Time           : %.6f s\n", t1 - t0);
+	printf("Requests/second: %.1f\n", n / (t1 - t0));
+	printf("Latency (us)   : %.1f mean, %.1f p50, %.1f p90, %.1f p99, %.1f p99.9, %.1f max\n",
+	       sum / n / 1e3, all[n / 2] / 1e3, all[n * 9 / 10] / 1e3, all[n * 99 / 100] / 1e3,
+	       all[n * 999 / 1000] / 1e3, all[n - 1] / 1e3);
+	
+	// The server's statistics, over every connection it has served.
+	f = fdopen(dup(fd), "r");
+	if(f != NULL && write(fd, "stats\n", 6) == 6 && getline(&line, &len, f) > 0){
+		printf("Server stats   : %s", line);
+	}
+	if(f != NULL){
+		fclose(f);
+	}
+	free(line);
+	close(fd);
+	free(all);
+	free(c);
+	return 0;
+}
+
+// Sends nreq random queries, keeping up to depth of them in flight, and
+// times each from when it was sent until its reply came back.
+void *run_client(void *arg){
+	client *c = arg;
+	uint64_t s = seed + 0x9e3779b97f4a7c15ull * (c->id + 1);
+	double *sent = malloc(depth * sizeof(double));
+	char b[256 * 64], *line = NULL;
+	size_t bn, len = 0;
+	long long int ns = 0, nr = 0;
+	int fd, k, l;
+	FILE *f;
+	c->lat = malloc(nreq * sizeof(double));
+	fd = connect_server();
+	if(sent == NULL || c->lat == NULL || fd < 0 || (f = fdopen(dup(fd), "r")) == NULL){
+		c->err = 1;
+		return NULL;
+	}
+	while(nr < nreq){
+		bn = 0;
+		for(k = 0; ns < nreq && ns - nr < depth && k < 64; k++, ns++){
+			bn += sprintf(b + bn, "%s%d %d %d %d %d\n", paths ? "path " : "", maze,
+			              (int) (splitmix64(&s) % mx), (int) (splitmix64(&s) % my),
+			              (int) (splitmix64(&s) % mx), (int) (splitmix64(&s) % my));
+			sent[ns % depth] = now();
+		}
+		if(bn && write(fd, b, bn) != (ssize_t) bn){
+			fprintf(stderr, "Client %d: sending failed.\n", c->id);
+			c->err = 1;
+			break;
+		}
+		if(getline(&line, &len, f) < 0){
+			fprintf(stderr, "Client %d: the server hung up.\n", c->id);
+			c->err = 1;
+			break;
+		}
+		c->lat[nr] = (now() - sent[nr % depth]) * 1e9;
+		if(sscanf(line, "%*d %*d %*d %*d %*d %d", &l) == 1 && l >= 0){
+			c->solved++;
+		}
+		nr++;
+	}
+	fclose(f);
+	close(fd);
+	free(line);
+	free(sent);
+	return NULL;
+}
+
+// splitmix64, a fast generator that is plenty for picking queries.
+uint64_t splitmix64(uint64_t *s){
+	uint64_t z = (*s += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+double now(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int cmp_double(const void *a, const void *b){
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
@@ -21,16 +21,52 @@
 // Enables fancy terminal features (maze coloring, tty detection, ioctl).
 #define FANCY_TERM
 
+// For fopencookie(), through which compressed mazes are read.
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #ifdef FANCY_TERM
 #include <unistd.h>
 #include <sys/ioctl.h>
 #endif
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#define HAVE_PERF
+#endif
+
 #include <time.h>
 
 #if _POSIX_C_SOURCE >= 199309L && defined(CLOCK_REALTIME)
@@ -46,6 +82,8 @@ struct timespec t_dimensions;
 struct timespec t_malloc;
 struct timespec t_zero;
 struct timespec t_parse;
+struct timespec t_fill;
+struct timespec t_contract;
 struct timespec t_initheap;
 struct timespec t_solve;
 struct timespec t_path;
@@ -53,40 +91,83 @@ struct timespec t_path;
 void timespec_diff(struct timespec *s, struct timespec *e, struct timespec *o);
 #endif
 
-#define printdiff(S,T1,T2) { timespec_diff(&T1, &T2, &t_diff); \
-	fprintf(stderr, "Time to " S ": %3ld.%09ld\n", t_diff.tv_sec, t_diff.tv_nsec); }
+#define printdiff(S,T1,T2) { timespec_diff(&T1, &T2, &t_diff); report_time(S, &t_diff); }
+
+// How the statistics at the end are reported: as text, or for --stats=json
+// as a single line of JSON, the last one on stderr, with the phase times
+// gathered by report_time() in jtname and jtsec.
+int stats_json;
+const char *jtname[16];
+double      jtsec[16];
+int         njt;
+
+// Hardware counters of --perf, one per event in pnames, read into pm at the
+// start and end of each phase by perf_mark(). pfd is -1 for an event the
+// system would not count.
+#define NPERF 4
+enum { PM_ZERO, PM_PARSE, PM_CONTRACT, PM_INITHEAP, PM_SOLVE, PM_PATH, NPM };
+int perf;
+int pfd[NPERF];
+unsigned long long int pm[NPM][NPERF];
+const char *pnames[NPERF] = {"cycles", "instructions", "cache_misses", "dtlb_misses"};
 
 // The following sets of defines and typedefs represent a choice between
 // different heuristics to use for the A* Search Algorithm. Using no distance
 // heuristic reduces the algorithm to be equivalent to a breadth-first search.
 // The 'pretty' distance heuristic produces paths which prioritize heading
 // straight towards the goal, all other things being equal. The efficient
-// heuristic, using integer arithmetic only, is faster and allows each maze
-// node to be stored in 16 rather than 20 (32bit) or 24 (64bit) bytes.
+// heuristic, using integer arithmetic only, is faster and keeps the heap's
+// f-scores at 4 rather than 8 bytes.
 // It also allows the discarding of more nodes faster, because it more
 // accurately predicts the distance between node and target. To see the
-// difference in output, run on a completely open maze.
+// difference in output, run on a completely open maze. H_INTEGRAL marks the
+// heuristics whose f-scores are small integers that never decrease along a
+// search, which is what the bucket open list relies on.
 
 //Pretty Distance Heuristic:
 //#define dist(X1,Y1,X2,Y2) sqrt((X1 - X2) * (X1 - X2) + (Y1 - Y2) * (Y1 - Y2))
 //typedef double h_t;
+//#define H_INTEGRAL 0
 
 //Efficient Distance Heuristic:
 #define dist(X1,Y1,X2,Y2) (abs(X1 - X2) + abs(Y1 - Y2))
 typedef int h_t;
+#define H_INTEGRAL 1
 
 //No Distance Heuristic:
 //#define dist(X1,Y1,X2,Y2) (0)
 //typedef int h_t;
+//#define H_INTEGRAL 1
+
 
+// Packed binary maze format, version 1, as written by `genmaze --binary`.
+// All integers are little-endian.
+//   bytes  0- 3: magic "MAZB"
+//   bytes  4- 7: format version
+//   bytes  8-11: width  (mx)
+//   bytes 12-15: height (my)
+// followed by my rows of (mx + 3) / 4 bytes. Cell j of a row is stored in
+// the two bits starting at bit 2 * (j % 4) of byte j / 4: the low bit is set
+// if the cell is open to the right, the high bit if it is open downwards.
+#define MAZB_MAGIC   "MAZB"
+#define MAZB_VERSION 1
+#define MAZB_HDRLEN  16
 
+// state is a set of flags: 1 open, 2 closed, 4 on the path. The reverse
+// search of the bidirectional mode, which runs from the start, keeps its own
+// open and closed flags in 8 and 16, its g-score in rgscore and its parent
+// direction in the high nibble of parent.
+// Everything but neighbors belongs to a single search, and is only valid if
+// the node's epoch matches the current one. A node from an earlier search
+// counts as unvisited, so repeated searches never have to clear the grid.
 typedef struct _node {
-	h_t  hscore;
 	int  gscore;
+	int  rgscore;
 	int  hindex;
 	char neighbors;
 	char state;
 	char parent;
+	unsigned char epoch;
 } node;
 
 int mx;
@@ -99,17 +180,513 @@ int ey;
 
 node **m;
 
-// Heap Realloc Increment
+// With LAYOUT_TILED the nodes are stored in square tiles of TS x TS nodes
+// (4 KiB, a page) rather than in rows, so that the cells above and below one
+// mostly sit in the same page and cache lines as it. Tiles are stored a row
+// of tiles at a time, and the grid is padded to whole tiles. Everything
+// reaches the nodes through NODE(), which hides the layout.
+#ifdef LAYOUT_TILED
+#define TB 4 // log2 of TS
+#define TS (1 << TB)
+node  *mt;
+size_t tpr; // Tiles per row of tiles
+static inline size_t cidx(int x, int y){
+	return (((size_t) (y >> TB) * tpr + (x >> TB)) << (2 * TB))
+	     | (size_t) ((y & (TS - 1)) << TB | (x & (TS - 1)));
+}
+#define NODE(X,Y) (mt[cidx((X), (Y))])
+#else
+#define NODE(X,Y) (m[(Y)][(X)])
+#endif
+
+unsigned char epoch; // Current search generation, see node
+
+// The compact grid, used instead of m with --compact. cn holds each cell's
+// neighbors in a nibble, two cells to a byte, with rows padded to whole bytes
+// so that row bands never share one. cc holds the rest of a cell in a byte:
+// the parent as a direction index (the direction is 1 << index) in bits 0-1,
+// the state flags 1, 2 and 4 in bits 2-4 and the g-score modulo 8 in bits 5-7.
+// The search over it is lazy, so an open node's full g-score is not needed:
+// it comes back as f - h when the node is popped. The g-scores offered to an
+// open node all come from closed neighbours, whose distances are exact, and
+// so are either its distance or two more, which 3 bits can tell apart.
+unsigned char *cn;
+unsigned char *cc;
+size_t cnr; // Bytes per row of cn
+
+size_t mlen; // Bytes of nodes mapped, see map_grid()
+
+#define CP(B) ((B) & 3)        // Parent direction index of a cc byte
+#define CS(B) (((B) >> 2) & 7) // State flags of a cc byte
+#define CG(B) ((B) >> 5)       // g-score modulo 8 of a cc byte
+#define CELL(P,S,G) ((P) | (S) << 2 | ((G) & 7) << 5)
+
+int plen; // Length of the path the last search found
+
+int binary; // Input is in the packed binary format rather than text.
+int bidir;  // Search from both ends at once.
+int batch;  // Answering a stream of queries, keep quiet about each one.
+int compact; // Keep the grid in cn and cc rather than m.
+int deadends; // Fill in dead ends before searching.
+int contract; // Search the junction graph rather than the grid.
+
+// The junction graph of --contract. Its vertices are the junctions and dead
+// ends of the maze, the cells with other than two openings, and its edges
+// the corridors of two-opening cells between them, weighted by length. Each
+// vertex keeps its id in the hindex of its node, which the lazy heap the
+// graph is searched with has no use for, and has an edge slot for each of
+// the four directions, 4 * id + log2(direction): the vertex at the other end
+// (-1 for none), the corridor's length and the direction leading back into
+// the corridor from there.
+int   gnv;
+int  *gvx;
+int  *gvy;
+int  *geto;
+int  *gew;
+char *gback;
+
+// Cache files of what was worked out from a maze, read back by later runs
+// on the same maze. In native byte order, they start with a ghdr. The
+// contracted graph file, written by --contract=GFILE, follows it with the
+// gvx, gvy, geto, gew and gback arrays, and the HPA* file, see hx, with the
+// hx, hy, hcs, hes, hdeg, het and hew arrays. A cache is only used for a
+// maze whose parsed neighbors have the checksum in its header, see
+// maze_sum(), as the size and time of the maze file do not tell apart two
+// mazes of one size written in the same second.
+#define MAZG_MAGIC   "MAZG"
+#define MAZG_VERSION 2
+#define MAZH_MAGIC   "MAZH"
+#define MAZH_VERSION 2
+typedef struct _ghdr {
+	char magic[4];
+	unsigned int version;
+	int  mx;
+	int  my;
+	long long int size; // Size of the maze file
+	uint64_t sum;       // Checksum of its neighbors
+	int  param; // Cluster size of the HPA* file, 0 for the graph
+	int  nv;    // Vertices or abstract nodes
+} ghdr;
+
+// Corridors of the current query's junction graph search that hold the start
+// or the end, as the junction and direction they leave from.
+int gdx[4];
+int gdy[4];
+int gdd[4];
+int gnd;
+
+int hpa; // Search the HPA* abstraction rather than the grid.
+
+int bitboard; // Breadth-first search 64 cells at a time, see bbr.
+int reach;    // Only find out whether the end can be reached, see bbr.
+
+// Bitboards of the bit-parallel engines. Row y of each plane is bbw words at
+// y * bbw, and bit x % 64 of word x / 64 stands for cell x. bbr and bbd have
+// the cells open to the right and downwards, bbv the cells reached so far.
+// The breadth-first search keeps its current and next wavefronts in bbf and
+// bbn, and each reached cell's distance from the end modulo 3 in bb0 and bb1
+// (the low and the high bit): the neighbours of a cell are one closer or one
+// further away, which modulo 3 are told apart, so the path is recovered by
+// walking down the distances from the start. Only the words around the
+// wavefront are worked on, listed in bbl (and the next ones in bbm), with
+// bbs marking the words already looked at in the current round.
+size_t    bbw;
+uint64_t *bbr;
+uint64_t *bbd;
+uint64_t *bbv;
+uint64_t *bbf;
+uint64_t *bbn;
+uint64_t *bb0;
+uint64_t *bb1;
+unsigned int *bbs;
+unsigned int  bbstamp;
+size_t   *bbl;
+size_t   *bbm;
+
+// dst |= a & b over n words, as fast as the CPU allows, see bb_init().
+void (*or_and)(uint64_t *dst, const uint64_t *a, const uint64_t *b, size_t n);
+
+// The distance field written by --distance-field=DFILE: the distance of every
+// cell from the end and the direction of its parent, which points one step
+// closer to it. In little-endian byte order, like MAZB, it has a header
+//   bytes  0- 3: magic "MAZD"
+//   bytes  4- 7: format version
+//   bytes  8-11: width  (mx)
+//   bytes 12-15: height (my)
+//   bytes 16-19: end x  (ex)
+//   bytes 20-23: end y  (ey)
+// then a 32-bit distance per cell, row by row (0xffffffff if the cell cannot
+// be reached), then the parents, row by row, (mx + 1) / 2 bytes per row and
+// a nibble per cell, the low one for the even x. The nibbles have the same
+// direction bits as neighbors, 0 for the end and the cells not reached.
+#define MAZD_MAGIC   "MAZD"
+#define MAZD_VERSION 1
+#define MAZD_HDRLEN  24
+char *dfn;
+
+// Incremental re-planning of --edits=EFILE. After the first search, walls
+// are opened and closed and the path repaired with LPA*, searching from the
+// end like the other engines, so that only the cells whose distance from it
+// changed are expanded again, and the path is traced from its g-scores.
+// Its state is kept apart from the nodes, which the full search it is
+// compared with under --verify uses. lg and lrhs hold each cell's g and rhs
+// plus one, by y * mx + x, with 0 for infinity so that the freshly mapped
+// arrays start out all infinite. The open list is a heap of lhn cells lhc
+// with keys lhk, and lpos has the position plus one of each cell in it, 0
+// for none. Its expansions are counted in lexp, apart from the searches'.
+#define LINF INT_MAX
+char *efn;
+int   everify;
+unsigned long long int lexp;
+int  *lg;
+int  *lrhs;
+unsigned int *lpos;
+size_t       *lhc;
+uint64_t     *lhk;
+size_t        lhn;
+
+// Out-of-core solving of --external=DIR, for mazes whose grid would not fit
+// in memory. The maze is copied into a scratch file in DIR as tiles of XT x
+// XT cells' neighbor nibbles, XTL bytes each and laid out like the compact
+// grid's rows, a row of tiles after another, and read back through a cache
+// of xcn tiles that makes room by dropping the least recently used one.
+// Cells are numbered tile by tile, see xid(), so that a tile's cells sort
+// together and a sorted list of cells visits each tile once.
+// The search is a breadth-first search from the end with delayed duplicate
+// detection, after Munagala and Ranade: level t + 1 is the neighbours of
+// level t less levels t and t - 1, the only earlier ones they can be in an
+// undirected graph, so no closed set is kept at all. Each level is stored
+// sorted in the levels file, ids xlo[t] to xlo[t + 1]. The neighbours of a
+// level are gathered in xrb, which is sorted and written to the runs file
+// as a run whenever it fills, and the runs are merged into the next level,
+// dropping duplicates and the cells of the two levels before on the way.
+// The path is walked from the start down through the levels, each step to
+// the neighbour found in the level below.
+#define XTB  8 // log2 of XT
+#define XT   (1 << XTB)
+#define XTL  ((size_t) XT * XT / 2)
+#define XIOB 8192 // ids per buffer of an xstream
+char  *xdir;
+int    xmem = 256; // MiB for the tile cache and the sorting, see --memory
+int    xtf; // Scratch files of the tiles, the levels and the runs
+int    xlf;
+int    xrf;
+size_t xtx; // Tiles across and down
+size_t xty;
+int    xbits; // Bits of the largest id
+int    xerr;  // Set if the tiles or the levels could not be written or read
+unsigned char *xband; // The row of tiles being parsed into, see xtile_row()
+void (*xrow)(char *hl, char *ul, char *dl, int i); // The parser it calls
+unsigned char *xtc; // The tile cache, xcn slots of XTL bytes
+size_t  xcn;
+size_t  xcused; // Slots filled so far
+int    *xslot;  // Slot of each tile, -1 if it is not cached
+size_t *xtile;  // Tile in each slot
+int    *xprev;  // Slots in order of use, xhead last used and xtail longest ago
+int    *xnext;
+int     xhead;
+int     xtail;
+uint64_t *xrb;
+uint64_t *xrt; // Room for sorting xrb
+size_t    xrn; // Ids xrb holds
+uint64_t *xlo;
+size_t    xal; // Entries allocated in xlo
+size_t    xnl; // Levels found
+int       xplev; // Level of the cell the path has got to
+unsigned long long int xhits;
+unsigned long long int xmisses;
+unsigned long long int xrbytes; // Bytes of scratch files read and written
+unsigned long long int xwbytes;
+unsigned long long int xruns;   // Runs spilled
+unsigned long long int xpasses; // Merges of runs into longer ones
+unsigned long long int xpeak;   // Cells of the largest level
+
+// A stream of ids in a scratch file, read through a buffer from id pos up to
+// end, or written from id pos on. One with fd -1 only reads the n ids that
+// are in b already.
+typedef struct _xstream {
+	int       fd;
+	uint64_t  pos;
+	uint64_t  end;
+	uint64_t *b;
+	size_t    n;
+	size_t    i;
+} xstream;
+
+// Where and how print_solution() writes the path. By default it goes to
+// solution.txt if it is longer than 100 steps and to stdout otherwise, a
+// line "(x, y)" per cell. PF_RLE writes the start and then the steps as runs
+// of a direction, "X Y R12 U3 L7 ...". PF_BIN writes a header like MAZB's,
+//   bytes  0- 3: magic "MAZP"
+//   bytes  4- 7: format version
+//   bytes  8-23: start x, start y, end x, end y
+//   bytes 24-31: number of steps
+// all little-endian, then the steps, 2 bits each, packed like MAZB's cells
+// (step k in the two bits at bit 2 * (k % 4) of byte k / 4): 0 up, 1 right,
+// 2 down, 3 left.
+#define MAZP_MAGIC   "MAZP"
+#define MAZP_VERSION 1
+#define MAZP_HDRLEN  32
+enum { PF_COORDS, PF_RLE, PF_BIN };
+int   pformat = PF_COORDS;
+char *pfn;
+
+// The image written by --image=IFILE, a binary PPM: with iscale 1, a 2 x 2
+// block of pixels per cell, the cell and the openings or walls to its right
+// and below it; with iscale N > 1, a pixel per N x N cells, blending their
+// colours, each darker the more walls it has, and red if any of them is on
+// the path. The framebuffer fb of fbw x fbh pixels is drawn in bands of
+// pixel rows across nthreads threads.
+char *ifn;
+int   iscale;
+unsigned char *fb;
+size_t fbw;
+size_t fbh;
+
+// The buffer print_solution() writes through, as paths run to tens of
+// millions of cells.
+#define OBUF (1 << 20)
+typedef struct _obuf {
+	FILE  *f;
+	size_t n;
+	char   b[OBUF];
+} obuf;
+
+// A wavefront of cells (y * mx + x) of the distance field search, one per
+// worker thread for the current level and one for the next.
+typedef struct _fbuf {
+	size_t *c;
+	size_t  n;
+	size_t  cap;
+} fbuf;
+
+// Worker threads wait for each other between levels here. Unlike a
+// pthread_barrier_t, it is told how many threads there are after they have
+// been started, once it is known how many could be.
+typedef struct _fbarrier {
+	pthread_mutex_t mu;
+	pthread_cond_t  cv;
+	int count;
+	int waiting;
+	unsigned int phase;
+} fbarrier;
+
+// State of the distance field search, see field_thread(). The wavefront
+// of the current level, fcur[0..fthreads-1], is handed out in chunks of
+// FCHUNK cells, numbered across all of them, through fnext. Levels of
+// fewer than FSERIAL cells are done by thread 0 alone.
+#define FCHUNK  256
+#define FSERIAL 4096
+fbuf    *fcur;
+fbuf    *fnxt;
+int      fthreads;
+size_t   fchunks;
+size_t   fnext;
+size_t   ftotal;
+int      flevel;
+int      ferr;
+unsigned long long int *freached;
+fbarrier fbar;
+
+// The HPA* abstraction of --hpa. The grid is cut into clusters of HC x HC
+// cells, and every cell with an opening into another cluster is an abstract
+// node, so that the abstraction loses no path and its searches are exact.
+// An abstract node's edges lead across the cluster border, with weight 1, and
+// to the other abstract nodes of its cluster it can reach without leaving
+// it, with the length of the shortest way there. The nodes are numbered
+// cluster by cluster, in row order of the clusters, and like the junction
+// graph's vertices keep their number in their node's hindex.
+#define HC 32
+int   hn;
+int  *hx;   // Abstract node coordinates
+int  *hy;
+int   hncx; // Clusters across and down
+int   hncy;
+int  *hcs;  // Abstract nodes of cluster c: hcs[c] .. hcs[c + 1] - 1
+long long int *hes; // Edges of abstract node i start at hes[i] in het and hew,
+int  *hdeg;         // and there are hdeg[i] of them.
+int  *het;  // Edge targets
+int  *hew;  // Edge weights
+
+// Per query: the abstract node each node was reached from (-1 for the end),
+// that of the start, the in-cluster distances from the start and from the
+// end, and a queue for the in-cluster searches.
+int  *hpred;
+int   spred;
+int  *hsd;
+int  *hed;
+int  *hq;
+
+int nthreads; // Worker threads for the parallel phases
+
+int pbench; // Rounds of the --parse-bench parse bandwidth benchmark.
+
+// Fills in the neighbors of row i from its line hl of the mapped text and the
+// lines of vertical passages above and below it, ul and dl (NULL at the
+// edges). Picked by pick_parser() from the versions below.
+void (*parse_row)(char *hl, char *ul, char *dl, int i);
+const char *parse_row_name;
+
+// A horizontal band of the grid, rows [r0, r1), handed to one worker thread.
+typedef struct _band {
+	int   id;
+	int   r0;
+	int   r1;
+	void *arg;
+	int   err;
+} band;
+
+// A compressed maze is decompressed by a thread of its own into a ring of
+// ZRN buffers of ZRB bytes, which the parser reads on through a stdio cookie
+// while the next ones are being filled.
+#define ZRN 8
+#define ZRB (1 << 20)
+typedef struct _zring {
+	FILE *f;             // The compressed file
+	unsigned char *in;   // Compressed bytes read from f
+	unsigned char *buf[ZRN];
+	size_t len[ZRN];
+	unsigned long filled; // Buffers filled by the thread so far
+	unsigned long taken;  // Buffers read to the end so far
+	size_t pos;          // Offset into buffer taken % ZRN
+	int done;            // 1 after the last buffer, -1 if it failed
+	int closing;
+	int end;             // Whether gzip input is between members, or zstd
+	                     // input has run out
+	int (*fill)(struct _zring *z, unsigned char *out, size_t *n);
+	pthread_mutex_t mu;
+	pthread_cond_t  cv;
+	pthread_t tid;
+	#ifdef HAVE_ZLIB
+	z_stream zs;
+	#endif
+	#ifdef HAVE_ZSTD
+	ZSTD_DStream *zd;
+	ZSTD_inBuffer zi;
+	#endif
+} zring;
+
+// Initial heap size. The heap doubles whenever it fills up.
 #define HRI 4096
 
-int *ohx; // Open node heap of x coordinates
-int *ohy; // Open node heap of y coordinates
-h_t *ohf; // Open node heap of f distance
-int ah;   // Allocated size of heap
-int nh;   // Used size of heap
+// Open list engines. The binary heap works with any heuristic and keeps each
+// open node's position in its hindex so that its f-score can be decreased in
+// place. The bucket queue needs H_INTEGRAL: with unit edge costs and a
+// consistent heuristic every f-score pushed lies within 2 (4 for the doubled
+// keys of the bidirectional search) of the smallest one still open, so a ring
+// of BQR LIFO buckets indexed by f gives O(1) push and pop. It never moves
+// entries; a node whose g-score improves is simply pushed again and its
+// stale entries are skipped when they surface, because by then the node has
+// already been closed. A heap can be made lazy the same way, which frees it
+// from hindex and lets two heaps share the node grid.
+#define OL_HEAP   0
+#define OL_BUCKET 1
+
+// Bucket Queue Ring size (a power of two larger than the f-score spread).
+#define BQR 8
+
+typedef struct _openlist {
+	int  engine;
+	int  closed; // State flag of nodes that are done, for skipping entries
+	int  lazy;   // Push improved nodes again rather than decreasing in place
+	
+	int *ohx; // Open node heap of x coordinates
+	int *ohy; // Open node heap of y coordinates
+	h_t *ohf; // Open node heap of f distance
+	int  ah;  // Allocated size of heap
+	int  nh;  // Used size of heap
+	
+	int *bx[BQR]; // Bucket entries, x and y coordinates
+	int *by[BQR];
+	int  ab[BQR]; // Allocated size of each bucket
+	int  nb[BQR]; // Used size of each bucket
+	int  bf;      // f-score of the lowest possibly non-empty bucket
+	long long int n; // Entries in all buckets
+	
+	h_t  pf; // f-score of the entry last popped
+} openlist;
+
+int qengine = H_INTEGRAL ? OL_BUCKET : OL_HEAP;
 
 unsigned long long int sc[4] = {0, 0, 0, 0};
-unsigned int hswaps = 0;
+unsigned long long int hswaps = 0;     // Heap entries swapped while sifting
+unsigned long long int expansions = 0; // Nodes taken off the open list
+unsigned long long int qpushes = 0;    // Entries put on the open list
+unsigned long long int qstale = 0;     // Bucket entries skipped as stale
+unsigned long long int qgrows = 0;     // Open list reallocations
+unsigned long long int qpeak = 0;      // Most entries on an open list at once
+
+// The mazes of --serve, parsed once and kept for the server's lifetime. Only
+// their neighbors are kept, as nibbles like the compact grid's cn: the rest
+// of a search belongs to the worker thread answering the query.
+typedef struct _smaze {
+	char  *name;
+	int    mx;
+	int    my;
+	size_t cnr;
+	unsigned char *cn;
+} smaze;
+
+#define SQN 64   // Connections waiting for a worker
+#define SRB 4096 // Longest request line
+#define SLH 164  // Latency histogram buckets, see lat_bucket()
+
+// A client connection of --serve, with the start of a request line that has
+// not all come in yet. Open connections are kept in a list, to be closed
+// when the server stops.
+typedef struct _sconn {
+	int    fd;
+	size_t have;
+	char   rb[SRB];
+	struct _sconn *prev;
+	struct _sconn *next;
+} sconn;
+
+// A worker thread of --serve, which answers the requests that have come in
+// on a connection and then goes on to whichever connection is next. cc is
+// its search state, laid out like the compact grid's and big enough for the
+// largest maze; the cells a search set in it are listed in tl, to be cleared
+// by the next search rather than all of cc. Its counters are guarded by mu,
+// as the stats request of any connection reads them.
+typedef struct _sworker {
+	pthread_t tid;
+	unsigned char *cc;
+	size_t *tl;
+	size_t  nt;
+	size_t  at;
+	size_t *bq[BQR]; // Bucket queue of cell indexes, as in openlist
+	size_t  bn[BQR];
+	size_t  ba[BQR];
+	char   *wb; // Replies not sent yet
+	size_t  wn;
+	size_t  wa;
+	pthread_mutex_t mu;
+	unsigned long long int nreq;
+	unsigned long long int nsolved;
+	unsigned long long int ninvalid;
+	unsigned long long int nexp;
+	unsigned long long int lsum; // Nanoseconds
+	unsigned long long int lmax;
+	unsigned long long int lat[SLH];
+} sworker;
+
+smaze   *sm;
+int      nsm;
+sworker *sw;
+int      nsw;
+
+// Connections with requests to answer, not yet taken by a worker, a ring of
+// SQN, and all the connections open.
+sconn *sq[SQN];
+int    sqh;
+int    sqn;
+int    sqstop;
+sconn *sconnl;
+unsigned long long int sconns;
+int    sep; // epoll instance the connections wait in
+pthread_mutex_t sqmu = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  sqcv = PTHREAD_COND_INITIALIZER;
+volatile sig_atomic_t serving;
 
 #ifdef FANCY_TERM
 int isttyi;
@@ -119,15 +696,159 @@ int isttye;
 char *tcolors[4] = {"\033[0m", "\033[32m", "\033[31m", "\033[34m"};
 #endif
 
+int  read_dimensions(FILE *in);
 int  alloc_maze(void);
 int  parse_maze(FILE *in);
+int  parse_binary(FILE *in);
+static void parse_binary_row(unsigned char *row, unsigned char *prow, int i);
+int  parse_mapped(FILE *in);
+void pick_parser(void);
+int  parse_bench(FILE *in);
+static void *map_grid(size_t len);
+unsigned char *map_input(FILE *in, size_t len, size_t *maplen);
+FILE *open_compressed(FILE *in);
+int  run_bands(int rows, void *(*fn)(void *), void *arg);
+int  fill_dead_ends(void);
+int  contract_maze(void);
+int  load_graph(FILE *in, char *gfn);
+int  save_graph(FILE *in, char *gfn);
+int  build_hpa(void);
+void free_hpa(void);
+int  load_hpa(FILE *in, char *hfn);
+int  save_hpa(FILE *in, char *hfn);
+int  bb_init(void);
+int  distance_field(void);
+int  save_field(char *dfn);
 void print_maze(void);
 void calc_results(int sx, int sy, int ex, int ey);
 void print_solution(int sx, int sy, int ex, int ey, FILE *f);
 void print_graphic_solution(void);
-int  check_heapness(void);
+int  render_image(char *ifn);
+int  check_heapness(openlist *ol);
+void report_time(const char *name, struct timespec *d);
+void perf_open(void);
+void perf_mark(int p);
+void print_stats(openlist ol[2], int solved);
 void print_help(void);
 
+int  ol_init(openlist *ol, int engine, int closed, int lazy);
+void ol_clear(openlist *ol);
+void ol_free(openlist *ol);
+int  ol_push(openlist *ol, int x, int y, h_t f);
+int  ol_decrease(openlist *ol, int x, int y, h_t f);
+int  ol_pop(openlist *ol, int *x, int *y);
+h_t  ol_peek(openlist *ol);
+long long int ol_size(openlist *ol);
+unsigned long long int ol_bytes(openlist *ol);
+
+void next_epoch(void);
+int  solve(openlist ol[2]);
+int  solve_astar(openlist *ol);
+int  solve_compact(openlist *ol);
+int  solve_graph(openlist *ol);
+int  solve_hpa(openlist *ol);
+int  solve_bitboard(void);
+int  solve_reach(void);
+int  solve_bidir(openlist ol[2]);
+int  run_queries(FILE *qf, openlist ol[2]);
+int  run_edits(FILE *ef, openlist ol[2]);
+int  serve(char *sfn, int nf, char **fns);
+int  run_external(FILE *in);
+void write_solution(void);
+
+// Brings a node into the current search, clearing what an earlier one left.
+static inline node *touch(node *n){
+	if(n->epoch != epoch){
+		n->epoch  = epoch;
+		n->state  = 0;
+		n->parent = 0;
+	}
+	return n;
+}
+
+// Accessors for the code outside the search loops, which works the same on
+// m and on the compact grid. node_state() gives the flags as of the last
+// search, with those of the reverse search folded into the usual ones.
+static inline int node_neighbors(int x, int y){
+	if(compact){
+		return (cn[(size_t) y * cnr + (x >> 1)] >> ((x & 1) << 2)) & 15;
+	}
+	return NODE(x, y).neighbors;
+}
+
+// Offset of cell (x, y)'s byte in the row of tiles of xband.
+static inline size_t xoff(int x, int y){
+	return (size_t) (x >> XTB) * XTL + ((size_t) (y & (XT - 1)) << (XTB - 1)) + ((x & (XT - 1)) >> 1);
+}
+
+static inline void add_neighbors(int x, int y, int nb){
+	if(compact){
+		cn[(size_t) y * cnr + (x >> 1)] |= nb << ((x & 1) << 2);
+	} else
+	if(xband != NULL){
+		xband[xoff(x, y)] |= nb << ((x & 1) << 2);
+	} else {
+		NODE(x, y).neighbors |= nb;
+	}
+}
+
+static inline int node_state(int x, int y){
+	if(compact){
+		return CS(cc[(size_t) y * mx + x]);
+	}
+	if(NODE(x, y).epoch != epoch){
+		return 0;
+	}
+	return NODE(x, y).state | ((NODE(x, y).state >> 3) & 3);
+}
+
+static inline int node_parent(int x, int y){
+	if(compact){
+		return 1 << CP(cc[(size_t) y * mx + x]);
+	}
+	return NODE(x, y).parent;
+}
+
+// Gives a cell a parent outside of the usual searches, which set it
+// themselves, marking it closed.
+static inline void set_parent(int x, int y, int d){
+	if(compact){
+		cc[(size_t) y * mx + x] = CELL(d ? __builtin_ctz(d) : 0, 2, 0);
+	} else {
+		node *n = touch(&NODE(x, y));
+		n->parent = d;
+		n->state  = 2;
+	}
+}
+
+static inline void mark_path(int x, int y){
+	if(compact){
+		cc[(size_t) y * mx + x] |= 4 << 2;
+	} else {
+		NODE(x, y).state |= 4;
+	}
+}
+
+// Clears the neighbors bits nb of a cell, safely against other threads doing
+// the same to it or to the other cell of its byte, and returns the neighbors
+// it had before.
+static inline int clear_neighbors(int x, int y, int nb){
+	if(compact){
+		int sh = (x & 1) << 2;
+		return (__atomic_fetch_and(&cn[(size_t) y * cnr + (x >> 1)], (unsigned char) ~(nb << sh),
+		                           __ATOMIC_RELAXED) >> sh) & 15;
+	}
+	return __atomic_fetch_and(&NODE(x, y).neighbors, (char) ~nb, __ATOMIC_RELAXED) & 15;
+}
+
+// Whether the node of an open list entry has already been closed.
+static inline int is_closed(openlist *ol, int x, int y){
+	if(compact){
+		return CS(cc[(size_t) y * mx + x]) & ol->closed;
+	}
+	return NODE(x, y).state & ol->closed;
+}
+
 int main(int argc, char *argv[]){
 	
 	#ifdef FANCY_TERM
@@ -136,12 +857,231 @@ int main(int argc, char *argv[]){
 	isttye = isatty(fileno(stderr));
 	#endif
 	
+	static struct option lopts[] = {
+		{"queue", required_argument, NULL, 'q'},
+		{"bidirectional", no_argument, NULL, 'b'},
+		{"queries", required_argument, NULL, 'Q'},
+		{"threads", required_argument, NULL, 'j'},
+		{"compact", no_argument, NULL, 'c'},
+		{"dead-ends", no_argument, NULL, 'd'},
+		{"contract", optional_argument, NULL, 'G'},
+		{"hpa", no_argument, NULL, 'H'},
+		{"bitboard", no_argument, NULL, 'B'},
+		{"reachable", no_argument, NULL, 'R'},
+		{"distance-field", required_argument, NULL, 'F'},
+		{"parse-bench", optional_argument, NULL, 'P'},
+		{"stats", required_argument, NULL, 'S'},
+		{"perf", no_argument, NULL, 'E'},
+		{"output", required_argument, NULL, 'o'},
+		{"format", required_argument, NULL, 'f'},
+		{"image", required_argument, NULL, 'I'},
+		{"image-scale", required_argument, NULL, 'Z'},
+		{"serve", required_argument, NULL, 'U'},
+		{"edits", required_argument, NULL, 'W'},
+		{"verify", no_argument, NULL, 'V'},
+		{"external", required_argument, NULL, 'X'},
+		{"memory", required_argument, NULL, 'K'},
+		{"help" , no_argument      , NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	char *qfn = NULL;
+	char *gfn = NULL;
+	char *sfn = NULL;
+	int opt;
+	while((opt = getopt_long(argc, argv, "q:bQ:j:cdG::HBRF:P::S:Eo:f:I:Z:U:W:VX:K:h", lopts, NULL)) != -1){
+		switch(opt){
+			case 'q':
+				if(!strcmp(optarg, "heap")){
+					qengine = OL_HEAP;
+				} else
+				if(!strcmp(optarg, "bucket") && H_INTEGRAL){
+					qengine = OL_BUCKET;
+				} else {
+					fprintf(stderr, "Unknown or unusable open list engine '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			case 'b':
+				bidir = 1;
+				break;
+			case 'Q':
+				qfn = optarg;
+				batch = 1;
+				break;
+			case 'j':
+				nthreads = atoi(optarg);
+				if(nthreads < 1){
+					fprintf(stderr, "Need at least one thread.\n");
+					return 1;
+				}
+				break;
+			case 'c':
+				compact = 1;
+				break;
+			case 'd':
+				deadends = 1;
+				break;
+			case 'G':
+				contract = 1;
+				gfn = optarg;
+				break;
+			case 'H':
+				hpa = 1;
+				break;
+			case 'B':
+				bitboard = 1;
+				break;
+			case 'R':
+				reach = 1;
+				break;
+			case 'F':
+				dfn = optarg;
+				break;
+			case 'S':
+				if(!strcmp(optarg, "json")){
+					stats_json = 1;
+				} else
+				if(!strcmp(optarg, "text")){
+					stats_json = 0;
+				} else {
+					fprintf(stderr, "Unknown statistics format '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			case 'E':
+				perf = 1;
+				break;
+			case 'o':
+				pfn = optarg;
+				break;
+			case 'I':
+				ifn = optarg;
+				break;
+			case 'Z':
+				iscale = atoi(optarg);
+				if(iscale < 1){
+					fprintf(stderr, "Invalid image scale.\n");
+					return 1;
+				}
+				break;
+			case 'U':
+				sfn = optarg;
+				break;
+			case 'W':
+				efn = optarg;
+				break;
+			case 'V':
+				everify = 1;
+				break;
+			case 'X':
+				xdir = optarg;
+				break;
+			case 'K':
+				xmem = atoi(optarg);
+				if(xmem < 1){
+					fprintf(stderr, "Invalid memory budget.\n");
+					return 1;
+				}
+				break;
+			case 'f':
+				if(!strcmp(optarg, "coords")){
+					pformat = PF_COORDS;
+				} else
+				if(!strcmp(optarg, "rle")){
+					pformat = PF_RLE;
+				} else
+				if(!strcmp(optarg, "bin")){
+					pformat = PF_BIN;
+				} else {
+					fprintf(stderr, "Unknown path format '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			case 'P':
+				pbench = optarg == NULL ? 5 : atoi(optarg);
+				if(pbench < 1){
+					fprintf(stderr, "Invalid number of rounds.\n");
+					return 1;
+				}
+				break;
+			default:
+				print_help();
+				return 1;
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if(compact && bidir){
+		fprintf(stderr, "The compact grid has no room for a bidirectional search.\n");
+		return 1;
+	}
+	if(deadends && batch){
+		fprintf(stderr, "Dead-end filling depends on the start and end, so it cannot answer queries.\n");
+		return 1;
+	}
+	if(contract && (compact || bidir)){
+		fprintf(stderr, "The junction graph is searched one way on the full grid, so -G goes with neither -c nor -b.\n");
+		return 1;
+	}
+	if(gfn != NULL && deadends){
+		fprintf(stderr, "A graph of the maze with its dead ends filled would not suit another run, so -G cannot save one with -d.\n");
+		return 1;
+	}
+	if(hpa && (compact || bidir || contract || deadends)){
+		fprintf(stderr, "The HPA* abstraction is searched one way on the full grid as read, so -H goes with none of -c, -b, -G and -d.\n");
+		return 1;
+	}
+	if((bitboard || reach) && (bidir || contract || hpa)){
+		fprintf(stderr, "The bitboard engines go with none of -b, -G and -H.\n");
+		return 1;
+	}
+	if(dfn != NULL && (batch || compact || bidir || deadends || contract || hpa || bitboard || reach)){
+		fprintf(stderr, "The distance field is worked out on its own, from the full grid as read, so -F goes with none of the other modes.\n");
+		return 1;
+	}
+	if(sfn != NULL && (batch || bidir || deadends || contract || hpa || bitboard || reach ||
+	                   dfn != NULL || pbench || pfn != NULL || ifn != NULL)){
+		fprintf(stderr, "The server answers queries with searches of its own over compact grids, so -U goes with none of the other modes.\n");
+		return 1;
+	}
+	if(everify && efn == NULL){
+		fprintf(stderr, "Only the repairs of -W can be verified.\n");
+		return 1;
+	}
+	if(efn != NULL && (batch || compact || bidir || deadends || contract || hpa || bitboard || reach ||
+	                   dfn != NULL || sfn != NULL)){
+		fprintf(stderr, "The wall edits are made to the full grid and repaired with LPA*, so -W goes with none of -Q, -c, -b, -d, -G, -H, -B, -R, -F and -U.\n");
+		return 1;
+	}
+	if(xdir != NULL && (batch || compact || bidir || deadends || contract || hpa || bitboard || reach ||
+	                    dfn != NULL || sfn != NULL || efn != NULL || ifn != NULL || pbench)){
+		fprintf(stderr, "The external solver keeps no grid in memory, only tiles of it, so -X goes with none of the other modes, nor with -I.\n");
+		return 1;
+	}
+	if(pformat == PF_BIN && pfn == NULL){
+		fprintf(stderr, "The binary path format needs a file to go to, given with -o.\n");
+		return 1;
+	}
+	if(contract || hpa){
+		// Edge weights vary, which the bucket queue cannot take.
+		qengine = OL_HEAP;
+	}
+	if(!nthreads){
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if(nthreads < 1){
+			nthreads = 1;
+		}
+	}
+	
 	if(argc < 2){
 		print_help();
 		return 1;
 	}
+	if(sfn != NULL){
+		return serve(sfn, argc - 1, argv + 1);
+	}
 	char *fn = argv[1];
-	if(argc == 6){
+	if(argc == 6 && !batch){
 		sx = atoi(argv[2]);
 		sy = atoi(argv[3]);
 		ex = atoi(argv[4]);
@@ -157,6 +1097,9 @@ int main(int argc, char *argv[]){
 		return 1;
 	}
 	
+	if(perf){
+		perf_open();
+	}
 	fprintf(stderr, "Reading dimensions... ");
 	#ifdef DO_TIMING
 	clock_getres (CLOCK_ID, &t_res);
@@ -171,57 +1114,48 @@ int main(int argc, char *argv[]){
 	}
 	if(in == NULL){
 		fprintf(stderr, "fopen on '%s' failed (%m).\n", fn);
+		return 1;
 	}
-	
-	char wstr[12], hstr[12];
-	int nstr = 0;
-	int c;
-	while(1){
-		c = fgetc(in);
-		if(c == EOF){
-			fprintf(stderr, "File ended while reading dimensions.\n");
-			return 1;
+	FILE *qf = NULL;
+	if(batch){
+		if(!strcmp(qfn, "-")){
+			qf = stdin;
+		} else {
+			qf = fopen(qfn, "r");
 		}
-		if(nstr == 12){
-			fprintf(stderr, "Dimension is too big! What are you thinking!?\n");
+		if(qf == NULL){
+			fprintf(stderr, "fopen on '%s' failed (%m).\n", qfn);
 			return 1;
 		}
-		if(c == ' '){
-			hstr[nstr] = '\0';
-			break;
-		}
-		hstr[nstr++] = c;
-	}
-	while(1){
-		c = fgetc(in);
-		if(c == EOF){
-			fprintf(stderr, "File ended while reading dimensions.\n");
+		if(qf == in){
+			fprintf(stderr, "The maze and the queries cannot both come from stdin.\n");
 			return 1;
 		}
-		if(c != ' '){
-			break;
-		}
 	}
-	nstr = 0;
-	while(1){
-		if(c == EOF){
-			fprintf(stderr, "File ended while reading dimensions.\n");
-			return 1;
+	FILE *ef = NULL;
+	if(efn != NULL){
+		if(!strcmp(efn, "-")){
+			ef = stdin;
+		} else {
+			ef = fopen(efn, "r");
 		}
-		if(nstr == 12){
-			fprintf(stderr, "Dimension is too big! What are you thinking!?\n");
+		if(ef == NULL){
+			fprintf(stderr, "fopen on '%s' failed (%m).\n", efn);
 			return 1;
 		}
-		if(c == '\n'){
-			wstr[nstr] = '\0';
-			break;
+		if(ef == in){
+			fprintf(stderr, "The maze and the edits cannot both come from stdin.\n");
+			return 1;
 		}
-		wstr[nstr++] = c;
-		c = fgetc(in);
+	}
+	in = open_compressed(in);
+	if(in == NULL){
+		return 1;
 	}
 	
-	mx = atoi(wstr);
-	my = atoi(hstr);
+	if(read_dimensions(in)){
+		return 1;
+	}
 	
 	fprintf(stderr, "width by height = %d x %d\n", mx, my);
 	
@@ -240,367 +1174,4895 @@ int main(int argc, char *argv[]){
 		}
 	}
 	
+	if(xdir != NULL){
+		return run_external(in);
+	}
+	
 	if(alloc_maze()){
 		return 1;
 	}
 	
-	fprintf(stderr, "Parsing...\n");
+	pick_parser();
+	if(pbench){
+		return parse_bench(in);
+	}
+	
+	fprintf(stderr, "Parsing (%d threads)...\n", nthreads);
 	#ifdef DO_TIMING
 	clock_gettime(CLOCK_ID, &t_zero);
+	perf_mark(PM_ZERO);
 	#endif
 	
-	if(parse_maze(in)){
+	if(binary ? parse_binary(in) : parse_mapped(in)){
 		return 1;
 	}
 	
-	fprintf(stderr, "Initializing heap (%d nodes)...\n", HRI);
 	#ifdef DO_TIMING
 	clock_gettime(CLOCK_ID, &t_parse);
+	perf_mark(PM_PARSE);
 	#endif
+	if(deadends){
+		fprintf(stderr, "Filling dead ends (%d threads)...\n", nthreads);
+		if(fill_dead_ends()){
+			return 1;
+		}
+	}
 	
-	nh = 1;
-	ah = HRI;
-	ohx = malloc(ah * sizeof(int));
-	ohy = malloc(ah * sizeof(int));
-	ohf = malloc(ah * sizeof(h_t));
-	ohx[0] = ex;
-	ohy[0] = ey;
-	ohf[0] = dist(ex,ey,sx,sy);
-	m[ey][ex].gscore = 0;
-	m[ey][ex].state = 1;
-	
-	fprintf(stderr, "Solving (%d, %d) -> (%d, %d)...\n", sx, sy, ex, ey);
 	#ifdef DO_TIMING
-	clock_gettime(CLOCK_ID, &t_initheap);
+	clock_gettime(CLOCK_ID, &t_fill);
 	#endif
-	
-	int x, y, solved = 0;
-	node *n, *tn;
-	int d;
-	int nx = 0, ny = 0;
-	int tg;
-	int better;
-	int hcur;
-	int hchild;
-	int hswap;
-	int tempx, tempy;
-	h_t tempf;
-	while(nh){
-		//printf("Heap length: %d\n", nh);
-		//printf("Heap:\n");
-		//for(hcur = 0; hcur < nh; hcur++){
-		//	printf("  (%d, %d, %.3lf)\n", ohx[hcur], ohy[hcur], ohf[hcur]);
-		//}
-		x = ohx[0];
-		y = ohy[0];
-		//fprintf(stderr, "Looking at (%d, %d)\n", x, y);
-		n = &(m[y][x]);
-		n->state = 2;
-		
-		if(x == sx && y == sy){
-			solved = 1;
-			break;
+	if(contract){
+		if(gfn == NULL || load_graph(in, gfn)){
+			fprintf(stderr, "Contracting corridors (%d threads)...\n", nthreads);
+			if(contract_maze() || (gfn != NULL && save_graph(in, gfn))){
+				return 1;
+			}
 		}
-		
-		// Remove n from the heap, replace it at the root with the last node.
-		ohx[0] = ohx[nh - 1];
-		ohy[0] = ohy[nh - 1];
-		ohf[0] = ohf[nh - 1];
-		m[ohy[0]][ohx[0]].hindex = 0;
-		
-		nh--;
-		
-		// Sift the new root back up.
-		hcur = 0;
-		while(2 * hcur + 1 < nh){
-			hchild = 2 * hcur + 1;
-			hswap = hcur;
-			if(ohf[hswap] > ohf[hchild]){
-				hswap = hchild;
-			}
-			if(hchild + 1 < nh && ohf[hswap] > ohf[hchild + 1]){
-				hswap = hchild + 1;
-			}
-			if(hswap != hcur){
-				tempx      = ohx[hcur];
-				tempy      = ohy[hcur];
-				tempf      = ohf[hcur];
-				ohx[hcur ] = ohx[hswap];
-				ohy[hcur ] = ohy[hswap];
-				ohf[hcur ] = ohf[hswap];
-				ohx[hswap] = tempx;
-				ohy[hswap] = tempy;
-				ohf[hswap] = tempf;
-				m[ohy[hcur ]][ohx[hcur ]].hindex = hcur;
-				m[ohy[hswap]][ohx[hswap]].hindex = hswap;
-				hcur = hswap;
-				hswaps++;
-			} else {
-				break;
+		fprintf(stderr, "Junction graph : %d vertices (%.2lf cells each)\n",
+		        gnv, (double) mx * my / (gnv ? gnv : 1));
+	}
+	if(hpa){
+		char *hfn = NULL;
+		if(in != stdin){
+			hfn = malloc(strlen(fn) + 5);
+			if(hfn == NULL){
+				fprintf(stderr, "File name malloc() failed.\n");
+				return 1;
 			}
+			sprintf(hfn, "%s.hpa", fn);
 		}
-		
-		for(d = 1; d < 16; d <<= 1){
-			if(!(n->neighbors & d)){
-				continue;
-			}
-			switch(d){
-				case 1:
-					nx = x;
-					ny = y - 1;
-					break;
-				case 2:
-					nx = x + 1;
-					ny = y;
-					break;
-				case 4:
-					nx = x;
-					ny = y + 1;
-					break;
-				case 8:
-					nx = x - 1;
-					ny = y;
-					break;
-			}
-			tn = &(m[ny][nx]);
-			if(tn->state & 2){
-				continue;
-			}
-			tg = n->gscore + 1;
-			if(tn->state == 0){
-				tn->state = 1;
-				if(nh == ah){
-					/*if(check_heapness()){
-						fprintf(stderr, "HEAPFAIL\n");
-					} else {
-						fprintf(stderr, "heappass\n");
-					}*/
-					ah += HRI;
-					fprintf(stderr, "Expanding heap to %d nodes, %d swaps so far.\n", ah, hswaps);
-					ohx = realloc(ohx, ah * sizeof(int));
-					ohy = realloc(ohy, ah * sizeof(int));
-					ohf = realloc(ohf, ah * sizeof(h_t));
-					if(ohx == NULL || ohy == NULL || ohf == NULL){
-						fprintf(stderr, "Heap realloc failed.\n");
-						return 1;
-					}
-				}
-				ohx[nh] = nx;
-				ohy[nh] = ny;
-				tn->hindex = nh;
-				nh++;
-				better = 1;
-			} else
-			if(tg < tn->gscore){
-				better = 1;
-			} else {
-				better = 0;
-			}
-			if(better){
-				tn->parent = ((d << 2) | (d >> 2)) & 15;
-				tn->gscore = tg;
-				tn->hscore = dist(nx,ny,sx,sy);
-				ohf[tn->hindex] = tg + tn->hscore;
-				
-				hcur = tn->hindex;
-				while(hcur > 0){
-					hswap = (hcur - 1) / 2;
-					if(ohf[hswap] > ohf[hcur]){
-						tempx      = ohx[hcur];
-						tempy      = ohy[hcur];
-						tempf      = ohf[hcur];
-						ohx[hcur ] = ohx[hswap];
-						ohy[hcur ] = ohy[hswap];
-						ohf[hcur ] = ohf[hswap];
-						ohx[hswap] = tempx;
-						ohy[hswap] = tempy;
-						ohf[hswap] = tempf;
-						tn->hindex = hcur;
-						m[ohy[hswap]][ohx[hswap]].hindex = hswap;
-						hcur = hswap;
-						hswaps++;
-					} else {
-						break;
-					}
-				}
+		if(hfn == NULL || load_hpa(in, hfn)){
+			fprintf(stderr, "Building %d x %d clusters (%d threads)...\n", HC, HC, nthreads);
+			if(build_hpa() || (hfn != NULL && save_hpa(in, hfn))){
+				return 1;
 			}
 		}
+		free(hfn);
+		fprintf(stderr, "HPA* clusters  : %d x %d, %d abstract nodes (%.2lf per cluster)\n",
+		        hncx, hncy, hn, (double) hn / ((double) hncx * hncy));
+	}
+	if(bitboard || reach){
+		fprintf(stderr, "Building bitboards...\n");
+		if(bb_init()){
+			return 1;
+		}
 	}
 	
+	fprintf(stderr, "Initializing %s open list...\n", qengine == OL_BUCKET ? "bucket" : "heap");
 	#ifdef DO_TIMING
-	clock_gettime(CLOCK_ID, &t_solve);
+	clock_gettime(CLOCK_ID, &t_contract);
+	perf_mark(PM_CONTRACT);
 	#endif
 	
-	if(!solved){
-		fprintf(stderr, "No path exists.\n");
-	} else {
-		fprintf(stderr, "Solved (length %d).\n", m[sy][sx].gscore);
-		if(m[sy][sx].gscore > 100){
-			fprintf(stderr, "The solution is longer than I want to print to stdout.\n"
-			                "  You may find it in solution.txt\n");
-			FILE *sf = fopen("solution.txt", "w");
-			if(sf == NULL){
-				fprintf(stderr, "fopen() on solution.txt failed (%m).\n");
-			} else {
-				print_solution(sx, sy, ex, ey, sf);
-			}
-			fclose(sf);
-		} else {
-			print_solution(sx, sy, ex, ey, stdout);
-		}
-		calc_results(sx, sy, ex, ey);
-		int termwidth;
-		#ifdef FANCY_TERM
-		if(isttyo){
-			struct winsize termsize;
-			ioctl(fileno(stdout), TIOCGWINSZ, &termsize);
-			termwidth = termsize.ws_col;
+	int solved = 0;
+	openlist ol[2];
+	if(ol_init(&ol[0], qengine, 2, bidir || compact || contract || hpa) || (bidir && ol_init(&ol[1], qengine, 16, 1))){
+		return 1;
+	}
+	
+	if(dfn != NULL){
+		fprintf(stderr, "Computing distances from (%d, %d) (%d threads)...\n", ex, ey, nthreads);
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_initheap);
+		perf_mark(PM_INITHEAP);
+		#endif
+		if(distance_field()){
+			return 1;
+		}
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_solve);
+		perf_mark(PM_SOLVE);
+		#endif
+		fprintf(stderr, "Writing %s...\n", dfn);
+		if(save_field(dfn)){
+			return 1;
+		}
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_path);
+		perf_mark(PM_PATH);
+		#endif
+	} else
+	if(efn != NULL){
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_initheap);
+		perf_mark(PM_INITHEAP);
+		#endif
+		solved = run_edits(ef, ol);
+		if(solved < 0){
+			return 1;
+		}
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_solve);
+		perf_mark(PM_SOLVE);
+		#endif
+		if(!solved){
+			fprintf(stderr, "No path exists.\n");
 		} else {
-			termwidth = -1;
+			fprintf(stderr, "Solved (length %d).\n", plen);
+			write_solution();
 		}
-		#else
-		termwidth = 80;
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_path);
+		perf_mark(PM_PATH);
+		#endif
+	} else
+	if(batch){
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_initheap);
+		perf_mark(PM_INITHEAP);
+		#endif
+		if(run_queries(qf, ol)){
+			return 1;
+		}
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_solve);
+		perf_mark(PM_SOLVE);
+		t_path = t_solve;
 		#endif
-		if(termwidth > 0 && 2 * mx >= termwidth){
-			fprintf(stderr, "The maze is too wide to be printed on your terminal.\n"
-			                "  I am therefore eliding the graphical representation.\n");
+	} else {
+		fprintf(stderr, "Solving (%d, %d) %s (%d, %d)...\n", sx, sy, bidir ? "<->" : "->", ex, ey);
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_initheap);
+		perf_mark(PM_INITHEAP);
+		#endif
+		
+		solved = solve(ol);
+		if(solved < 0){
+			return 1;
+		}
+		
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_solve);
+		perf_mark(PM_SOLVE);
+		#endif
+		
+		if(!solved){
+			fprintf(stderr, "No path exists.\n");
+		} else
+		if(reach){
+			fprintf(stderr, "Reachable.\n");
 		} else {
-			print_graphic_solution();
+			fprintf(stderr, "Solved (length %d).\n", plen);
+			write_solution();
+			calc_results(sx, sy, ex, ey);
+			int termwidth;
+			#ifdef FANCY_TERM
+			if(isttyo){
+				struct winsize termsize;
+				ioctl(fileno(stdout), TIOCGWINSZ, &termsize);
+				termwidth = termsize.ws_col;
+			} else {
+				termwidth = -1;
+			}
+			#else
+			termwidth = 80;
+			#endif
+			if(termwidth > 0 && 2 * mx >= termwidth){
+				fprintf(stderr, "The maze is too wide to be printed on your terminal.\n"
+				                "  I am therefore eliding the graphical representation.\n");
+			} else {
+				print_graphic_solution();
+			}
+			if(ifn != NULL && render_image(ifn)){
+				return 1;
+			}
 		}
+		
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_path);
+		perf_mark(PM_PATH);
+		#endif
 	}
 	
 	#ifdef DO_TIMING
-	clock_gettime(CLOCK_ID, &t_path);
-	
 	printdiff("get dimensions ", t_start     , t_dimensions);
 	printdiff("allocate memory", t_dimensions, t_malloc    );
-	printdiff("zero memory    ", t_malloc    , t_zero      );
 	printdiff("parse file     ", t_zero      , t_parse     );
-	printdiff("init the heap  ", t_parse     , t_initheap  );
-	printdiff("solve the maze ", t_initheap  , t_solve     );
-	printdiff("display results", t_solve     , t_path      );
+	if(deadends){
+		printdiff("fill dead ends ", t_parse     , t_fill      );
+	}
+	if(contract){
+		printdiff("contract maze  ", t_fill      , t_contract  );
+	}
+	if(hpa){
+		printdiff("build clusters ", t_fill      , t_contract  );
+	}
+	if(bitboard || reach){
+		printdiff("build bitboards", t_fill      , t_contract  );
+	}
+	printdiff("init the heap  ", t_contract  , t_initheap  );
+	if(batch){
+		printdiff("answer queries ", t_initheap  , t_solve     );
+	} else
+	if(efn != NULL){
+		printdiff("apply edits    ", t_initheap  , t_solve     );
+		printdiff("display results", t_solve     , t_path      );
+	} else {
+		printdiff("solve the maze ", t_initheap  , t_solve     );
+		printdiff("display results", t_solve     , t_path      );
+	}
 	printdiff("do everything  ", t_start     , t_path      );
 	#else
 	fprintf(stderr, "Mac OSX does not support clock_gettime(), so I didn't time anything.\n");
 	#endif
+	print_stats(ol, solved);
 	
-	free(m[0]);
-	free(m);
-	free(ohx);
-	free(ohy);
-	free(ohf);
+	if(contract){
+		free(gvx);
+		free(gvy);
+		free(geto);
+		free(gew);
+		free(gback);
+	}
+	if(bitboard || reach){
+		free(bbr);
+		free(bbd);
+		free(bbv);
+		free(bbf);
+		free(bbn);
+		free(bb0);
+		free(bb1);
+		free(bbs);
+		free(bbl);
+		free(bbm);
+	}
+	if(hpa){
+		free_hpa();
+	}
+	if(compact){
+		munmap(cn, cnr * my);
+		munmap(cc, (size_t) mx * my);
+	} else {
+		#ifdef LAYOUT_TILED
+		munmap(mt, mlen);
+		#else
+		munmap(m[0], mlen);
+		free(m);
+		#endif
+	}
+	ol_free(&ol[0]);
+	if(bidir){
+		ol_free(&ol[1]);
+	}
 	if(in != stdin){
 		fclose(in);
 	}
+	if(qf != NULL && qf != stdin){
+		fclose(qf);
+	}
+	if(ef != NULL && ef != stdin){
+		fclose(ef);
+	}
 	
 	return 0;
 }
 
-#ifdef DO_TIMING
-void timespec_diff(struct timespec *s, struct timespec *e, struct timespec *o){
-	if((e->tv_nsec - s->tv_nsec) < 0){
-		o->tv_sec  =              e->tv_sec  - s->tv_sec - 1;
-		o->tv_nsec = 1000000000 + e->tv_nsec - s->tv_nsec;
-	} else {
-		o->tv_sec  = e->tv_sec  - s->tv_sec;
-		o->tv_nsec = e->tv_nsec - s->tv_nsec;
+// Runs whichever search the options and the grid call for.
+int solve(openlist ol[2]){
+	int r;
+	if(bidir){
+		return solve_bidir(ol);
+	}
+	if(contract){
+		return solve_graph(&ol[0]);
+	}
+	if(hpa){
+		r = solve_hpa(&ol[0]);
+		if(r == -2){
+			// The abstraction was loaded from a cache that does not fit the
+			// maze after all. Build it afresh and search again.
+			fprintf(stderr, "The HPA* clusters do not fit the maze, rebuilding them (%d threads)...\n", nthreads);
+			free_hpa();
+			if(build_hpa()){
+				return -1;
+			}
+			r = solve_hpa(&ol[0]);
+			if(r == -2){
+				fprintf(stderr, "The HPA* path could not be refined into cells.\n");
+				return -1;
+			}
+		}
+		return r;
+	}
+	if(reach){
+		return solve_reach();
 	}
+	if(bitboard){
+		return solve_bitboard();
+	}
+	return compact ? solve_compact(&ol[0]) : solve_astar(&ol[0]);
 }
-#endif
 
-int alloc_maze(void){
-	int i;
-	unsigned long long int l = (unsigned long long int) my * sizeof(node *)
-	                         + (unsigned long long int) my * mx * sizeof(node);
-	if(l > 0xffffffffu && sizeof(size_t) == 4){
-		fprintf(stderr, "Size of malloc (0x%08llx,%08llx or 0d%llu bytes) "
-		                "overflows a 32 bit unsigned int (size_t).\n",
-		        l >> 32, l & 0xffffffffu, l);
-		return 1;
+// Searches from (ex, ey) towards (sx, sy), leaving each reached node's
+// gscore as its distance from the end and its parent pointing back towards
+// the end. Returns 1 if a path was found, 0 if not and -1 on error.
+int solve_astar(openlist *ol){
+	next_epoch();
+	ol_clear(ol);
+	touch(&NODE(ex, ey));
+	if(ol_push(ol, ex, ey, dist(ex,ey,sx,sy))){
+		return -1;
 	}
-	if(sizeof(node *) == 8){
-		fprintf(stderr, "malloc()'ing 0x%08llx,%08llx (0d%llu) bytes (%d rows x %d columns x %lu bytes per node + %d rows x %lu bytes per row pointer)...\n",
-		                l >> 32, l & 0xffffffffu, l,
-		                my, mx, sizeof(node), my, sizeof(node *));
-	} else {
-		fprintf(stderr, "malloc()'ing 0x%08llx (0d%llu) bytes (%d rows x %d columns x %lu bytes per node + %d rows x %lu bytes per row pointer)...\n",
-		                l, l,
-		                my, mx, sizeof(node), my, sizeof(node *));
+	NODE(ex, ey).gscore = 0;
+	NODE(ex, ey).state = 1;
+	
+	int x, y, solved = 0;
+	node *n, *tn;
+	int d;
+	int nx = 0, ny = 0;
+	int tg;
+	int opened;
+	while(ol_pop(ol, &x, &y)){
+		//fprintf(stderr, "Looking at (%d, %d)\n", x, y);
+		n = &NODE(x, y);
+		n->state = 2;
+		expansions++;
+		
+		if(x == sx && y == sy){
+			plen = n->gscore;
+			solved = 1;
+			break;
+		}
+		
+		for(d = 1; d < 16; d <<= 1){
+			if(!(n->neighbors & d)){
+				continue;
+			}
+			switch(d){
+				case 1:
+					nx = x;
+					ny = y - 1;
+					break;
+				case 2:
+					nx = x + 1;
+					ny = y;
+					break;
+				case 4:
+					nx = x;
+					ny = y + 1;
+					break;
+				case 8:
+					nx = x - 1;
+					ny = y;
+					break;
+			}
+			tn = touch(&NODE(nx, ny));
+			if(tn->state & 2){
+				continue;
+			}
+			tg = n->gscore + 1;
+			if(tn->state == 0){
+				tn->state = 1;
+				opened = 1;
+			} else
+			if(tg < tn->gscore){
+				opened = 0;
+			} else {
+				continue;
+			}
+			tn->parent = ((d << 2) | (d >> 2)) & 15;
+			tn->gscore = tg;
+			if(opened ? ol_push    (ol, nx, ny, tg + dist(nx,ny,sx,sy))
+			          : ol_decrease(ol, nx, ny, tg + dist(nx,ny,sx,sy))){
+				return -1;
+			}
+		}
+	}
+	return solved;
+}
+
+// solve_astar() on the compact grid, see cc. The grid is cleared for every
+// search, as there is no room for an epoch.
+int solve_compact(openlist *ol){
+	memset(cc, 0, (size_t) mx * my);
+	ol_clear(ol);
+	if(ol_push(ol, ex, ey, dist(ex,ey,sx,sy))){
+		return -1;
+	}
+	cc[(size_t) ey * mx + ex] = CELL(0, 1, 0);
+	
+	int x, y, solved = 0;
+	size_t c, tc;
+	int nb, k, d;
+	int nx = 0, ny = 0;
+	int g, tg;
+	unsigned char t;
+	while(ol_pop(ol, &x, &y)){
+		c = (size_t) y * mx + x;
+		// Rounded, in case h_t is floating point.
+		g = (int) (ol->pf - dist(x,y,sx,sy) + 0.5);
+		cc[c] = CELL(CP(cc[c]), 2, g);
+		expansions++;
+		
+		if(x == sx && y == sy){
+			plen = g;
+			solved = 1;
+			break;
+		}
+		
+		nb = (cn[(size_t) y * cnr + (x >> 1)] >> ((x & 1) << 2)) & 15;
+		for(k = 0; k < 4; k++){
+			d = 1 << k;
+			if(!(nb & d)){
+				continue;
+			}
+			switch(d){
+				case 1:
+					nx = x;
+					ny = y - 1;
+					break;
+				case 2:
+					nx = x + 1;
+					ny = y;
+					break;
+				case 4:
+					nx = x;
+					ny = y + 1;
+					break;
+				case 8:
+					nx = x - 1;
+					ny = y;
+					break;
+			}
+			tc = (size_t) ny * mx + nx;
+			t = cc[tc];
+			if(CS(t) & 2){
+				continue;
+			}
+			tg = g + 1;
+			if(CS(t) && ((CG(t) - tg) & 7) != 2){
+				continue;
+			}
+			cc[tc] = CELL((k + 2) & 3, 1, tg);
+			if(ol_push(ol, nx, ny, tg + dist(nx,ny,sx,sy))){
+				return -1;
+			}
+		}
+	}
+	return solved;
+}
+
+// Whether a cell of the junction graph search is one it stops at: a vertex
+// of the graph or, if ends is set, the start or the end.
+static inline int is_stop(int x, int y, int nb, int ends){
+	return __builtin_popcount(nb) != 2 ||
+	       (ends && ((x == sx && y == sy) || (x == ex && y == ey)));
+}
+
+// Follows the corridor leaving (*x, *y) in direction d to the next cell it
+// stops at (see is_stop()), which is left in *x and *y, with the direction
+// leading back into the corridor from it in *back. Returns the corridor's
+// length. If path is set, the cells in between get the direction they are
+// left in as their parent, as if a search from the far end had reached them.
+// A corridor that is a loop without a junction stops where it started.
+static int corridor(int *x, int *y, int d, int ends, int *back, int path){
+	int x0 = *x, y0 = *y;
+	int len = 0;
+	int nb;
+	while(1){
+		switch(d){
+			case 1:
+				(*y)--;
+				break;
+			case 2:
+				(*x)++;
+				break;
+			case 4:
+				(*y)++;
+				break;
+			case 8:
+				(*x)--;
+				break;
+		}
+		len++;
+		nb = NODE(*x, *y).neighbors;
+		if(is_stop(*x, *y, nb, ends) || (*x == x0 && *y == y0)){
+			break;
+		}
+		d = nb & ~(((d << 2) | (d >> 2)) & 15);
+		if(path){
+			touch(&NODE(*x, *y))->parent = d;
+		}
+	}
+	*back = ((d << 2) | (d >> 2)) & 15;
+	return len;
+}
+
+// Notes the corridors holding (x, y), unless it is a vertex itself, so that
+// the search walks them rather than taking their edges across it.
+static void split_corridors(int x, int y){
+	int nb = NODE(x, y).neighbors;
+	int d, cx, cy, back;
+	if(is_stop(x, y, nb, 0)){
+		return;
+	}
+	for(d = 1; d < 16; d <<= 1){
+		if(!(nb & d)){
+			continue;
+		}
+		cx = x;
+		cy = y;
+		corridor(&cx, &cy, d, 0, &back, 0);
+		gdx[gnd] = cx;
+		gdy[gnd] = cy;
+		gdd[gnd] = back;
+		gnd++;
+	}
+}
+
+// solve_astar() on the junction graph. The start and the end need not be
+// vertices: the corridors they lie on are walked cell by cell rather than
+// taken as edges, with the walk stopping at them, which splits the corridors
+// at the start and the end for the one search. Each vertex reached gets the
+// direction of the corridor leading back towards the end as its parent, and
+// once the start is found the corridors along the path are walked again to
+// give their cells parents too.
+int solve_graph(openlist *ol){
+	next_epoch();
+	ol_clear(ol);
+	gnd = 0;
+	split_corridors(sx, sy);
+	split_corridors(ex, ey);
+	touch(&NODE(ex, ey));
+	if(ol_push(ol, ex, ey, dist(ex,ey,sx,sy))){
+		return -1;
+	}
+	NODE(ex, ey).gscore = 0;
+	NODE(ex, ey).state = 1;
+	
+	int x, y, solved = 0;
+	node *n, *tn;
+	int d, k, e, t;
+	int nx, ny;
+	int tg, back;
+	int opened;
+	while(ol_pop(ol, &x, &y)){
+		n = &NODE(x, y);
+		n->state = 2;
+		expansions++;
+		
+		if(x == sx && y == sy){
+			solved = 1;
+			break;
+		}
+		
+		for(k = 0; k < 4; k++){
+			d = 1 << k;
+			if(!(n->neighbors & d)){
+				continue;
+			}
+			e = !is_stop(x, y, n->neighbors, 0);
+			for(t = 0; !e && t < gnd; t++){
+				e = gdx[t] == x && gdy[t] == y && gdd[t] == d;
+			}
+			if(e){
+				nx = x;
+				ny = y;
+				tg = n->gscore + corridor(&nx, &ny, d, 1, &back, 0);
+			} else {
+				e = 4 * n->hindex + k;
+				nx = gvx[geto[e]];
+				ny = gvy[geto[e]];
+				tg = n->gscore + gew[e];
+				back = gback[e];
+			}
+			if(nx == x && ny == y){
+				continue;
+			}
+			tn = touch(&NODE(nx, ny));
+			if(tn->state & 2){
+				continue;
+			}
+			if(tn->state == 0){
+				tn->state = 1;
+				opened = 1;
+			} else
+			if(tg < tn->gscore){
+				opened = 0;
+			} else {
+				continue;
+			}
+			tn->parent = back;
+			tn->gscore = tg;
+			if(opened ? ol_push    (ol, nx, ny, tg + dist(nx,ny,sx,sy))
+			          : ol_decrease(ol, nx, ny, tg + dist(nx,ny,sx,sy))){
+				return -1;
+			}
+		}
+	}
+	if(!solved){
+		return 0;
+	}
+	plen = NODE(sx, sy).gscore;
+	x = sx;
+	y = sy;
+	while(x != ex || y != ey){
+		corridor(&x, &y, NODE(x, y).parent, 1, &back, 1);
+	}
+	return 1;
+}
+
+// Breadth-first search from (x0, y0) that does not leave its cluster. Leaves
+// the distance of each cell of the cluster in d, by row and column within the
+// cluster, or -1 if the cell cannot be reached. q is the queue, HC * HC long.
+static void cluster_bfs(int x0, int y0, int *d, int *q){
+	int bx = x0 / HC * HC;
+	int by = y0 / HC * HC;
+	int w = mx - bx < HC ? mx - bx : HC;
+	int h = my - by < HC ? my - by : HC;
+	int qh = 0, qt = 1;
+	int c, x, y, nb, k;
+	int nx = 0, ny = 0;
+	for(c = 0; c < HC * HC; c++){
+		d[c] = -1;
+	}
+	q[0] = (y0 - by) * HC + x0 - bx;
+	d[q[0]] = 0;
+	while(qh < qt){
+		c = q[qh++];
+		x = bx + c % HC;
+		y = by + c / HC;
+		nb = NODE(x, y).neighbors;
+		for(k = 1; k < 16; k <<= 1){
+			if(!(nb & k)){
+				continue;
+			}
+			switch(k){
+				case 1:
+					nx = x;
+					ny = y - 1;
+					break;
+				case 2:
+					nx = x + 1;
+					ny = y;
+					break;
+				case 4:
+					nx = x;
+					ny = y + 1;
+					break;
+				case 8:
+					nx = x - 1;
+					ny = y;
+					break;
+			}
+			if(nx < bx || nx >= bx + w || ny < by || ny >= by + h ||
+			   d[(ny - by) * HC + nx - bx] >= 0){
+				continue;
+			}
+			d[(ny - by) * HC + nx - bx] = d[c] + 1;
+			q[qt++] = (ny - by) * HC + nx - bx;
+		}
+	}
+}
+
+static inline int same_cluster(int x1, int y1, int x2, int y2){
+	return x1 / HC == x2 / HC && y1 / HC == y2 / HC;
+}
+
+// Index of (x, y) in the distances of cluster_bfs() from a cell of its cluster.
+static inline int cluster_cell(int x, int y){
+	return (y % HC) * HC + x % HC;
+}
+
+// Reaches (x, y) from abstract node from (-1 for the end) with g-score tg,
+// for solve_hpa().
+static int hpa_relax(openlist *ol, int x, int y, int tg, int from){
+	node *tn = touch(&NODE(x, y));
+	int opened;
+	if(tn->state & 2){
+		return 0;
+	}
+	if(tn->state == 0){
+		tn->state = 1;
+		opened = 1;
+	} else
+	if(tg < tn->gscore){
+		opened = 0;
+	} else {
+		return 0;
+	}
+	tn->gscore = tg;
+	if(x == sx && y == sy){
+		spred = from;
+	} else {
+		hpred[tn->hindex] = from;
+	}
+	return opened ? ol_push    (ol, x, y, tg + dist(x,y,sx,sy))
+	              : ol_decrease(ol, x, y, tg + dist(x,y,sx,sy));
+}
+
+// solve_astar() on the HPA* abstraction. The end is joined to the abstract
+// nodes of its cluster, and every node of the start's cluster to the start,
+// by in-cluster searches from both. The path found is then refined into cells
+// one step at a time: across a cluster border, or within a cluster down the
+// distances of a search from the step's far end, each cell getting the
+// direction it is left in as its parent. Returns -2 if an abstract edge
+// cannot be refined, or the cells do not add up to its length, as happens
+// if the abstraction is not of this maze.
+int solve_hpa(openlist *ol){
+	next_epoch();
+	ol_clear(ol);
+	cluster_bfs(sx, sy, hsd, hq);
+	cluster_bfs(ex, ey, hed, hq);
+	touch(&NODE(ex, ey));
+	if(ol_push(ol, ex, ey, dist(ex,ey,sx,sy))){
+		return -1;
+	}
+	NODE(ex, ey).gscore = 0;
+	NODE(ex, ey).state = 1;
+	
+	int x, y, solved = 0;
+	node *n;
+	int u, c, i, k;
+	long long int e;
+	int px, py, steps = 0;
+	int nx = 0, ny = 0;
+	while(ol_pop(ol, &x, &y)){
+		n = &NODE(x, y);
+		n->state = 2;
+		expansions++;
+		
+		if(x == sx && y == sy){
+			solved = 1;
+			break;
+		}
+		
+		u = hn && hx[n->hindex] == x && hy[n->hindex] == y ? n->hindex : -1;
+		if(u >= 0){
+			for(e = hes[u]; e < hes[u] + hdeg[u]; e++){
+				if(hpa_relax(ol, hx[het[e]], hy[het[e]], n->gscore + hew[e], u)){
+					return -1;
+				}
+			}
+		} else {
+			// The end, which is not an abstract node itself.
+			c = y / HC * hncx + x / HC;
+			for(i = hcs[c]; i < hcs[c + 1]; i++){
+				if(hed[cluster_cell(hx[i], hy[i])] > 0 &&
+				   hpa_relax(ol, hx[i], hy[i], hed[cluster_cell(hx[i], hy[i])], -1)){
+					return -1;
+				}
+			}
+		}
+		if(same_cluster(x, y, sx, sy) && hsd[cluster_cell(x, y)] >= 0 &&
+		   hpa_relax(ol, sx, sy, n->gscore + hsd[cluster_cell(x, y)], u)){
+			return -1;
+		}
+	}
+	if(!solved){
+		return 0;
+	}
+	plen = NODE(sx, sy).gscore;
+	x = sx;
+	y = sy;
+	u = spred;
+	while(x != ex || y != ey){
+		px = u < 0 ? ex : hx[u];
+		py = u < 0 ? ey : hy[u];
+		if(same_cluster(x, y, px, py)){
+			cluster_bfs(px, py, hq + HC * HC, hq);
+		}
+		while(x != px || y != py){
+			for(k = 1; k < 16; k <<= 1){
+				if(!(NODE(x, y).neighbors & k)){
+					continue;
+				}
+				switch(k){
+					case 1:
+						nx = x;
+						ny = y - 1;
+						break;
+					case 2:
+						nx = x + 1;
+						ny = y;
+						break;
+					case 4:
+						nx = x;
+						ny = y + 1;
+						break;
+					case 8:
+						nx = x - 1;
+						ny = y;
+						break;
+				}
+				if(same_cluster(x, y, px, py) ?
+				   same_cluster(nx, ny, px, py) &&
+				   hq[HC * HC + cluster_cell(nx, ny)] == hq[HC * HC + cluster_cell(x, y)] - 1 :
+				   nx == px && ny == py){
+					break;
+				}
+			}
+			if(k == 16 || ++steps > plen){
+				return -2;
+			}
+			touch(&NODE(x, y))->parent = k;
+			x = nx;
+			y = ny;
+		}
+		if(u >= 0){
+			u = hpred[u];
+		}
+	}
+	return steps == plen ? 1 : -2;
+}
+
+static inline int bb_bit(uint64_t *plane, int x, int y){
+	return (plane[y * bbw + (x >> 6)] >> (x & 63)) & 1;
+}
+
+// The cells of word c that the wavefront in bbf reaches next, leaving out
+// those reached before.
+static inline uint64_t bb_expand(size_t c){
+	size_t i = c % bbw;
+	uint64_t f = bbf[c];
+	uint64_t w;
+	// Right from x to x + 1, and left from x + 1 to x, both through the
+	// opening to the right of x.
+	w  = (f & bbr[c]) << 1;
+	w |= (f >> 1) & bbr[c];
+	if(i > 0){
+		w |= (bbf[c - 1] & bbr[c - 1]) >> 63;
+	}
+	if(i < bbw - 1){
+		w |= (bbf[c + 1] << 63) & bbr[c];
+	}
+	// Down from the row above and up from the row below.
+	if(c >= bbw){
+		w |= bbf[c - bbw] & bbd[c - bbw];
+	}
+	if(c + bbw < (size_t) my * bbw){
+		w |= bbf[c + bbw] & bbd[c];
+	}
+	return w & ~bbv[c];
+}
+
+// Breadth-first search from (ex, ey), a whole wavefront of cells at a time,
+// on the bitboards. Words are only looked at if the wavefront is in them or
+// in one of the four words around them. Once the start is reached, the path
+// is walked back down the distances, giving each cell on it its parent.
+int solve_bitboard(void){
+	size_t nw = (size_t) my * bbw;
+	size_t nl = 0, nm, k, c;
+	size_t cand[5];
+	int nc, j;
+	int x, y, d, lvl, level = 0, solved = 0;
+	uint64_t w;
+	size_t *tl;
+	memset(bbv, 0, nw * sizeof(uint64_t));
+	memset(bbf, 0, nw * sizeof(uint64_t));
+	memset(bb0, 0, nw * sizeof(uint64_t));
+	memset(bb1, 0, nw * sizeof(uint64_t));
+	c = ey * bbw + (ex >> 6);
+	bbv[c] = bbf[c] = 1ULL << (ex & 63);
+	bbl[nl++] = c;
+	expansions++;
+	solved = sx == ex && sy == ey;
+	while(nl && !solved){
+		level++;
+		if(++bbstamp == 0){
+			memset(bbs, 0, nw * sizeof(unsigned int));
+			bbstamp = 1;
+		}
+		nm = 0;
+		for(k = 0; k < nl; k++){
+			c = bbl[k];
+			nc = 0;
+			cand[nc++] = c;
+			if(c % bbw > 0){
+				cand[nc++] = c - 1;
+			}
+			if(c % bbw < bbw - 1){
+				cand[nc++] = c + 1;
+			}
+			if(c >= bbw){
+				cand[nc++] = c - bbw;
+			}
+			if(c + bbw < nw){
+				cand[nc++] = c + bbw;
+			}
+			for(j = 0; j < nc; j++){
+				if(bbs[cand[j]] == bbstamp){
+					continue;
+				}
+				bbs[cand[j]] = bbstamp;
+				w = bb_expand(cand[j]);
+				if(w){
+					bbn[cand[j]] = w;
+					bbm[nm++] = cand[j];
+				}
+			}
+		}
+		for(k = 0; k < nl; k++){
+			bbf[bbl[k]] = 0;
+		}
+		for(k = 0; k < nm; k++){
+			c = bbm[k];
+			w = bbn[c];
+			bbn[c] = 0;
+			bbf[c]  = w;
+			bbv[c] |= w;
+			if(level % 3 & 1){
+				bb0[c] |= w;
+			}
+			if(level % 3 & 2){
+				bb1[c] |= w;
+			}
+			expansions += __builtin_popcountll(w);
+		}
+		tl = bbl;
+		bbl = bbm;
+		bbm = tl;
+		nl = nm;
+		solved = bb_bit(bbf, sx, sy);
+	}
+	if(!solved){
+		return 0;
+	}
+	plen = level;
+	if(compact){
+		memset(cc, 0, (size_t) mx * my);
+	} else {
+		next_epoch();
+	}
+	set_parent(ex, ey, 0);
+	x = sx;
+	y = sy;
+	while(level > 0){
+		lvl = (level + 2) % 3;
+		for(d = 1; d < 16; d <<= 1){
+			if(!(node_neighbors(x, y) & d)){
+				continue;
+			}
+			switch(d){
+				case 1:
+					y--;
+					break;
+				case 2:
+					x++;
+					break;
+				case 4:
+					y++;
+					break;
+				case 8:
+					x--;
+					break;
+			}
+			if(bb_bit(bbv, x, y) && (bb_bit(bb0, x, y) | bb_bit(bb1, x, y) << 1) == lvl){
+				break;
+			}
+			switch(d){
+				case 1:
+					y++;
+					break;
+				case 2:
+					x--;
+					break;
+				case 4:
+					y--;
+					break;
+				case 8:
+					x++;
+					break;
+			}
+		}
+		// Set the parent of the cell just left, the one opposite of d.
+		switch(d){
+			case 1:
+				set_parent(x, y + 1, d);
+				break;
+			case 2:
+				set_parent(x - 1, y, d);
+				break;
+			case 4:
+				set_parent(x, y - 1, d);
+				break;
+			case 8:
+				set_parent(x + 1, y, d);
+				break;
+		}
+		level--;
+	}
+	return 1;
+}
+
+// Floods row y of bbv along its openings to the right, to the ends of the
+// runs of open cells its reached cells are in. Within a word, a run is
+// crossed in six doubling steps: after the one by s, the cells reachable by
+// fewer than 2s steps are in g, and p has the cells from which the next 2s
+// steps to the right are all open. Returns whether the row changed.
+static int bb_fill_row(int y){
+	uint64_t *v = bbv + y * bbw;
+	uint64_t *r = bbr + y * bbw;
+	uint64_t g, p, carry = 0;
+	uint64_t changed = 0;
+	int i, sh;
+	for(i = 0; i < (int) bbw; i++){
+		g = v[i] | carry;
+		p = r[i];
+		for(sh = 1; sh < 64; sh <<= 1){
+			g |= (g & p) << sh;
+			p &= p >> sh;
+		}
+		carry = (g & r[i]) >> 63;
+		changed |= g ^ v[i];
+		v[i] = g;
+	}
+	carry = 0;
+	for(i = bbw - 1; i >= 0; i--){
+		g = v[i] | carry;
+		p = r[i];
+		for(sh = 1; sh < 64; sh <<= 1){
+			g |= (g >> sh) & p;
+			p &= p >> sh;
+		}
+		carry = i > 0 && (g & 1) ? r[i - 1] & (1ULL << 63) : 0;
+		changed |= g ^ v[i];
+		v[i] = g;
+	}
+	return changed != 0;
+}
+
+// Whether (sx, sy) can be reached from (ex, ey) at all. Sweeps down and then
+// up the bitboards, carrying the reached cells of each row through the
+// openings into the next one and flooding that along its own openings. That
+// settles open mazes in a sweep or two, but a winding passage only gets as
+// far as its first turn back per sweep, so after BB_SWEEPS of them whatever
+// is left is flooded from the reached cells like the breadth-first search
+// does, a run of open cells per word at a time.
+#define BB_SWEEPS 4
+int solve_reach(void){
+	size_t nw = (size_t) my * bbw;
+	size_t nl = 0, nm, k, c;
+	size_t cand[5];
+	int nc, j, y, changed, sweeps = 0;
+	uint64_t w, g, p;
+	size_t *tl;
+	memset(bbv, 0, nw * sizeof(uint64_t));
+	bbv[ey * bbw + (ex >> 6)] = 1ULL << (ex & 63);
+	bb_fill_row(ey);
+	do {
+		changed = 0;
+		for(y = 1; y < my; y++){
+			or_and(bbv + y * bbw, bbv + (y - 1) * bbw, bbd + (y - 1) * bbw, bbw);
+			changed |= bb_fill_row(y);
+		}
+		for(y = my - 2; y >= 0; y--){
+			or_and(bbv + y * bbw, bbv + (y + 1) * bbw, bbd + y * bbw, bbw);
+			changed |= bb_fill_row(y);
+		}
+		expansions++;
+	} while(changed && !bb_bit(bbv, sx, sy) && ++sweeps < BB_SWEEPS);
+	if(!changed || bb_bit(bbv, sx, sy)){
+		return bb_bit(bbv, sx, sy);
+	}
+	for(c = 0; c < nw; c++){
+		bbf[c] = bbv[c];
+		if(bbv[c]){
+			bbl[nl++] = c;
+		}
+	}
+	while(nl && !bb_bit(bbv, sx, sy)){
+		if(++bbstamp == 0){
+			memset(bbs, 0, nw * sizeof(unsigned int));
+			bbstamp = 1;
+		}
+		nm = 0;
+		for(k = 0; k < nl; k++){
+			c = bbl[k];
+			nc = 0;
+			cand[nc++] = c;
+			if(c % bbw > 0){
+				cand[nc++] = c - 1;
+			}
+			if(c % bbw < bbw - 1){
+				cand[nc++] = c + 1;
+			}
+			if(c >= bbw){
+				cand[nc++] = c - bbw;
+			}
+			if(c + bbw < nw){
+				cand[nc++] = c + bbw;
+			}
+			for(j = 0; j < nc; j++){
+				if(bbs[cand[j]] == bbstamp){
+					continue;
+				}
+				bbs[cand[j]] = bbstamp;
+				w = bb_expand(cand[j]);
+				if(w){
+					// Along the runs of open cells, as in bb_fill_row().
+					g = w;
+					p = bbr[cand[j]];
+					for(y = 1; y < 64; y <<= 1){
+						g |= (g & p) << y;
+						g |= (g >> y) & p;
+						p &= p >> y;
+					}
+					bbn[cand[j]] = g & ~bbv[cand[j]];
+					bbm[nm++] = cand[j];
+				}
+			}
+		}
+		for(k = 0; k < nl; k++){
+			bbf[bbl[k]] = 0;
+		}
+		for(k = 0; k < nm; k++){
+			c = bbm[k];
+			bbf[c]  = bbn[c];
+			bbv[c] |= bbn[c];
+			bbn[c]  = 0;
+		}
+		tl = bbl;
+		bbl = bbm;
+		bbm = tl;
+		nl = nm;
+		expansions++;
+	}
+	return bb_bit(bbv, sx, sy);
+}
+
+static void fb_wait(fbarrier *b){
+	unsigned int phase;
+	pthread_mutex_lock(&b->mu);
+	phase = b->phase;
+	if(++b->waiting == b->count){
+		b->waiting = 0;
+		b->phase++;
+		pthread_cond_broadcast(&b->cv);
+	} else {
+		while(phase == b->phase){
+			pthread_cond_wait(&b->cv, &b->mu);
+		}
+	}
+	pthread_mutex_unlock(&b->mu);
+}
+
+static inline int fbuf_push(fbuf *f, size_t c){
+	size_t *nc;
+	if(f->n == f->cap){
+		nc = realloc(f->c, 2 * f->cap * sizeof(size_t));
+		if(nc == NULL){
+			return 1;
+		}
+		f->c = nc;
+		f->cap *= 2;
+	}
+	f->c[f->n++] = c;
+	return 0;
+}
+
+// Claims the open neighbours of cell c not reached yet for the next level,
+// adding them to f. A cell is claimed by whichever thread first turns its
+// state from 0 to closed, so each is added once however many reach it.
+static inline int field_expand(size_t c, fbuf *f, unsigned long long int *reached){
+	int x = c % mx;
+	int y = c / mx;
+	int d, nx, ny;
+	char open;
+	node *n;
+	int nb = NODE(x, y).neighbors;
+	for(d = 1; d < 16; d <<= 1){
+		if(!(nb & d)){
+			continue;
+		}
+		nx = x;
+		ny = y;
+		switch(d){
+			case 1:
+				ny--;
+				break;
+			case 2:
+				nx++;
+				break;
+			case 4:
+				ny++;
+				break;
+			case 8:
+				nx--;
+				break;
+		}
+		n = &NODE(nx, ny);
+		open = 0;
+		if(!__atomic_compare_exchange_n(&n->state, &open, 2, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+			continue;
+		}
+		n->gscore = flevel + 1;
+		n->parent = ((d << 2) | (d >> 2)) & 15;
+		(*reached)++;
+		if(fbuf_push(f, (size_t) ny * mx + nx)){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Does the levels whose wavefront is too small to be worth sharing out on
+// thread 0, having first gathered the whole wavefront into its buffer, and
+// then numbers the chunks of the next level for the threads to share.
+static void field_serial(void){
+	int t;
+	size_t k;
+	fbuf tf;
+	for(t = 1; t < fthreads; t++){
+		for(k = 0; k < fcur[t].n && !ferr; k++){
+			ferr = fbuf_push(&fcur[0], fcur[t].c[k]);
+		}
+		fcur[t].n = 0;
+	}
+	while(!ferr && fcur[0].n && (fcur[0].n < FSERIAL || fthreads == 1)){
+		for(k = 0; k < fcur[0].n && !ferr; k++){
+			ferr = field_expand(fcur[0].c[k], &fnxt[0], &freached[0]);
+		}
+		tf = fcur[0];
+		fcur[0] = fnxt[0];
+		fnxt[0] = tf;
+		fnxt[0].n = 0;
+		flevel++;
+	}
+	fchunks = 0;
+	ftotal  = 0;
+	for(t = 0; t < fthreads; t++){
+		fchunks += (fcur[t].n + FCHUNK - 1) / FCHUNK;
+		ftotal  += fcur[t].n;
+	}
+	if(ferr){
+		ftotal = 0;
+	}
+	fnext = 0;
+}
+
+// One worker of the level-synchronous breadth-first search. Every level,
+// the threads take chunks of the wavefront in turn until none are left,
+// each adding the cells it claims to its own buffer for the next level.
+static void *field_thread(void *arg){
+	band *b = arg;
+	int t = b->id;
+	size_t k, i, c;
+	fbuf tf;
+	for(;;){
+		if(t == 0){
+			field_serial();
+		}
+		fb_wait(&fbar);
+		if(ftotal == 0){
+			break;
+		}
+		while((k = __sync_fetch_and_add(&fnext, 1)) < fchunks){
+			for(i = 0; k >= (fcur[i].n + FCHUNK - 1) / FCHUNK; i++){
+				k -= (fcur[i].n + FCHUNK - 1) / FCHUNK;
+			}
+			for(c = k * FCHUNK; c < fcur[i].n && c < (k + 1) * FCHUNK; c++){
+				if(field_expand(fcur[i].c[c], &fnxt[t], &freached[t])){
+					b->err = 1;
+					break;
+				}
+			}
+		}
+		fb_wait(&fbar);
+		// Only now that no thread reads the current level any more.
+		tf = fcur[t];
+		fcur[t] = fnxt[t];
+		fnxt[t] = tf;
+		fnxt[t].n = 0;
+		if(b->err){
+			ferr = 1;
+		}
+		if(t == 0){
+			flevel++;
+		}
+		fb_wait(&fbar);
+	}
+	return NULL;
+}
+
+// Clears the search state of rows [r0, r1) for the distance field.
+static void *field_clear_band(void *arg){
+	band *b = arg;
+	int i, j;
+	node *n;
+	for(i = b->r0; i < b->r1; i++){
+		for(j = 0; j < mx; j++){
+			n = &NODE(j, i);
+			n->epoch  = epoch;
+			n->state  = 0;
+			n->parent = 0;
+		}
+	}
+	return NULL;
+}
+
+// Works out the distance of every cell from (ex, ey), in gscore, and the
+// direction towards it, in parent, with a breadth-first search a level at a
+// time across nthreads threads. Cells that cannot be reached stay unvisited
+// (state 0), with no parent.
+int distance_field(void){
+	int t, nt;
+	unsigned long long int total = 0;
+	band *b;
+	pthread_t *tid;
+	if(++epoch == 0){
+		epoch = 1;
+	}
+	if(run_bands(my, field_clear_band, NULL)){
+		return 1;
+	}
+	fcur = calloc(nthreads, sizeof(fbuf));
+	fnxt = calloc(nthreads, sizeof(fbuf));
+	freached = calloc(nthreads, sizeof(unsigned long long int));
+	b   = calloc(nthreads, sizeof(band));
+	tid = malloc(nthreads * sizeof(pthread_t));
+	if(fcur == NULL || fnxt == NULL || freached == NULL || b == NULL || tid == NULL){
+		fprintf(stderr, "Distance field malloc() failed.\n");
+		return 1;
+	}
+	for(t = 0; t < nthreads; t++){
+		fcur[t].cap = fnxt[t].cap = FCHUNK;
+		fcur[t].c = malloc(FCHUNK * sizeof(size_t));
+		fnxt[t].c = malloc(FCHUNK * sizeof(size_t));
+		if(fcur[t].c == NULL || fnxt[t].c == NULL){
+			fprintf(stderr, "Wavefront malloc() failed.\n");
+			return 1;
+		}
+		b[t].id = t;
+	}
+	NODE(ex, ey).state  = 2;
+	NODE(ex, ey).gscore = 0;
+	fcur[0].c[fcur[0].n++] = (size_t) ey * mx + ex;
+	freached[0] = 1;
+	flevel = 0;
+	ferr   = 0;
+	pthread_mutex_init(&fbar.mu, NULL);
+	pthread_cond_init(&fbar.cv, NULL);
+	fbar.waiting = 0;
+	fbar.phase   = 0;
+	// Threads that start before fbar.count is set wait for it on the mutex.
+	pthread_mutex_lock(&fbar.mu);
+	for(nt = 1; nt < nthreads; nt++){
+		if(pthread_create(&tid[nt], NULL, field_thread, &b[nt])){
+			fprintf(stderr, "pthread_create() failed, going on with %d threads.\n", nt);
+			break;
+		}
+	}
+	fthreads = nt;
+	fbar.count = nt;
+	pthread_mutex_unlock(&fbar.mu);
+	field_thread(&b[0]);
+	for(t = 1; t < nt; t++){
+		pthread_join(tid[t], NULL);
+	}
+	for(t = 0; t < nthreads; t++){
+		total += freached[t];
+		free(fcur[t].c);
+		free(fnxt[t].c);
+	}
+	expansions += total;
+	free(fcur);
+	free(fnxt);
+	free(freached);
+	free(b);
+	free(tid);
+	pthread_mutex_destroy(&fbar.mu);
+	pthread_cond_destroy(&fbar.cv);
+	if(ferr){
+		fprintf(stderr, "Wavefront realloc() failed.\n");
+		return 1;
+	}
+	fprintf(stderr, "Distance field : %llu cells reached (%8.4lf%%), the farthest %d steps away\n",
+	        total, (double) total * 100 / ((double) mx * my), flevel - 1);
+	return 0;
+}
+
+// Writes the distance field to dfn, see MAZD_MAGIC.
+int save_field(char *dfn){
+	FILE *df = fopen(dfn, "w");
+	unsigned char hdr[MAZD_HDRLEN];
+	unsigned int hv[5] = {MAZD_VERSION, mx, my, ex, ey};
+	unsigned char *row;
+	unsigned int g;
+	int i, j, k;
+	node *n;
+	if(df == NULL){
+		fprintf(stderr, "fopen on '%s' failed (%m).\n", dfn);
+		return 1;
+	}
+	row = malloc(4 * (size_t) mx);
+	if(row == NULL){
+		fprintf(stderr, "Row malloc() failed.\n");
+		fclose(df);
+		return 1;
+	}
+	memcpy(hdr, MAZD_MAGIC, 4);
+	for(k = 0; k < 5; k++){
+		hdr[4 * k + 4] = hv[k];
+		hdr[4 * k + 5] = hv[k] >> 8;
+		hdr[4 * k + 6] = hv[k] >> 16;
+		hdr[4 * k + 7] = hv[k] >> 24;
+	}
+	fwrite(hdr, 1, MAZD_HDRLEN, df);
+	for(i = 0; i < my; i++){
+		for(j = 0; j < mx; j++){
+			n = &NODE(j, i);
+			g = n->state ? (unsigned int) n->gscore : 0xffffffffu;
+			row[4 * j    ] = g;
+			row[4 * j + 1] = g >> 8;
+			row[4 * j + 2] = g >> 16;
+			row[4 * j + 3] = g >> 24;
+		}
+		fwrite(row, 4, mx, df);
+	}
+	for(i = 0; i < my; i++){
+		memset(row, 0, (mx + 1) / 2);
+		for(j = 0; j < mx; j++){
+			n = &NODE(j, i);
+			if(n->state){
+				row[j >> 1] |= n->parent << ((j & 1) << 2);
+			}
+		}
+		fwrite(row, 1, (mx + 1) / 2, df);
+	}
+	free(row);
+	if(ferror(df) | fclose(df)){
+		fprintf(stderr, "Writing '%s' failed.\n", dfn);
+		return 1;
+	}
+	return 0;
+}
+
+// Searches from both ends at once: the usual search from (ex, ey) and a
+// reverse one from (sx, sy), each expanding from whichever open list is
+// smaller. Both are keyed on the average of the two heuristics, which keeps
+// the keys consistent in either direction; doubled so they stay integral,
+// a node's key is 2g + dist(node, target) - dist(node, source). Every node
+// reached by both searches gives a candidate path, and once the two lowest
+// open keys add up to twice the best candidate, no shorter path can exist.
+// The reverse parents between the meeting node and the start are then turned
+// around so the whole path reads like a one-directional solution.
+// Returns 1 if a path was found, 0 if not and -1 on error.
+int solve_bidir(openlist ol[2]){
+	int tx[2] = {sx, ex};
+	int ty[2] = {sy, ey};
+	next_epoch();
+	ol_clear(&ol[0]);
+	ol_clear(&ol[1]);
+	touch(&NODE(ex, ey));
+	touch(&NODE(sx, sy));
+	if(ol_push(&ol[0], ex, ey, dist(ex,ey,sx,sy)) ||
+	   ol_push(&ol[1], sx, sy, dist(sx,sy,ex,ey))){
+		return -1;
+	}
+	NODE(ex, ey).gscore  = 0;
+	NODE(ex, ey).state  |= 1;
+	NODE(sx, sy).rgscore = 0;
+	NODE(sx, sy).state  |= 8;
+	
+	int best = INT_MAX;
+	int bx = ex, by = ey;
+	if(sx == ex && sy == ey){
+		best = 0;
+	}
+	int x, y, solved = 0;
+	node *n, *tn;
+	int s, d;
+	int nx = 0, ny = 0;
+	int tg;
+	int *g, *tgs;
+	int opened;
+	h_t k[2];
+	while(1){
+		k[0] = ol_peek(&ol[0]);
+		k[1] = ol_peek(&ol[1]);
+		if(k[0] == INT_MAX || k[1] == INT_MAX ||
+		   (best != INT_MAX && k[0] + k[1] >= 2 * best)){
+			solved = best != INT_MAX;
+			break;
+		}
+		s = ol_size(&ol[1]) < ol_size(&ol[0]);
+		if(!ol_pop(&ol[s], &x, &y)){
+			continue;
+		}
+		n = &NODE(x, y);
+		n->state |= s ? 16 : 2;
+		expansions++;
+		g = s ? &n->rgscore : &n->gscore;
+		
+		for(d = 1; d < 16; d <<= 1){
+			if(!(n->neighbors & d)){
+				continue;
+			}
+			switch(d){
+				case 1:
+					nx = x;
+					ny = y - 1;
+					break;
+				case 2:
+					nx = x + 1;
+					ny = y;
+					break;
+				case 4:
+					nx = x;
+					ny = y + 1;
+					break;
+				case 8:
+					nx = x - 1;
+					ny = y;
+					break;
+			}
+			tn = touch(&NODE(nx, ny));
+			if(tn->state & (s ? 16 : 2)){
+				continue;
+			}
+			tgs = s ? &tn->rgscore : &tn->gscore;
+			tg = *g + 1;
+			if(!(tn->state & (s ? 8 : 1))){
+				tn->state |= s ? 8 : 1;
+				opened = 1;
+			} else
+			if(tg < *tgs){
+				opened = 0;
+			} else {
+				continue;
+			}
+			if(s){
+				tn->parent = (tn->parent & 15) | (((d << 2) | (d >> 2)) & 15) << 4;
+			} else {
+				tn->parent = (tn->parent & ~15) | (((d << 2) | (d >> 2)) & 15);
+			}
+			*tgs = tg;
+			k[s] = 2 * tg + dist(nx,ny,tx[s],ty[s]) - dist(nx,ny,tx[!s],ty[!s]);
+			if(opened ? ol_push    (&ol[s], nx, ny, k[s])
+			          : ol_decrease(&ol[s], nx, ny, k[s])){
+				return -1;
+			}
+			if(tn->state & (s ? 3 : 24) && tn->gscore + tn->rgscore < best){
+				best = tn->gscore + tn->rgscore;
+				bx = nx;
+				by = ny;
+			}
+		}
+	}
+	if(!solved){
+		return 0;
+	}
+	plen = best;
+	
+	// Follow the reverse parents from the meeting node to the start, pointing
+	// each node's forward parent at the node before it, then drop the reverse
+	// parents between the meeting node and the end.
+	int pd;
+	x = bx;
+	y = by;
+	tg = NODE(x, y).gscore;
+	d = (NODE(x, y).parent >> 4) & 15;
+	while(x != sx || y != sy){
+		switch(d){
+			case 1:
+				y--;
+				break;
+			case 2:
+				x++;
+				break;
+			case 4:
+				y++;
+				break;
+			case 8:
+				x--;
+				break;
+		}
+		pd = (NODE(x, y).parent >> 4) & 15;
+		NODE(x, y).parent = ((d << 2) | (d >> 2)) & 15;
+		NODE(x, y).gscore = ++tg;
+		d = pd;
+	}
+	x = bx;
+	y = by;
+	while(x != ex || y != ey){
+		pd = NODE(x, y).parent & 15;
+		NODE(x, y).parent = pd;
+		switch(pd){
+			case 1:
+				y--;
+				break;
+			case 2:
+				x++;
+				break;
+			case 4:
+				y++;
+				break;
+			case 8:
+				x--;
+				break;
+		}
+	}
+	NODE(x, y).parent &= 15;
+	return 1;
+}
+
+// Starts a new search generation. When the counter wraps around, every node
+// is reset to generation 0 so that none of them can look current by accident.
+void next_epoch(void){
+	int i, j;
+	if(++epoch == 0){
+		for(i = 0; i < my; i++){
+			for(j = 0; j < mx; j++){
+				NODE(j, i).epoch = 0;
+			}
+		}
+		epoch = 1;
+	}
+}
+
+// Answers one query per line of qf, each "START_X START_Y END_X END_Y", with
+// a line "START_X START_Y END_X END_Y LENGTH EXPANSIONS SECONDS" on stdout.
+// LENGTH is -1 if there is no path and the line reads "... invalid" if the
+// coordinates are out of range. Blank lines and lines starting with '#' are
+// skipped. Aggregate figures go to stderr at the end.
+int run_queries(FILE *qf, openlist ol[2]){
+	char line[256];
+	int solved;
+	unsigned long long int nq = 0, ns = 0, xp;
+	unsigned long long int tot = 0, totlen = 0;
+	double t, tmin = 0, tmax = 0, ttot = 0;
+	#ifdef DO_TIMING
+	struct timespec q0, q1;
+	#endif
+	fprintf(stderr, "Answering queries...\n");
+	while(fgets(line, sizeof(line), qf) != NULL){
+		if(line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)){
+			continue;
+		}
+		if(sscanf(line, "%d %d %d %d", &sx, &sy, &ex, &ey) != 4){
+			fprintf(stderr, "Malformed query: %s", line);
+			continue;
+		}
+		if(sx < 0 || sx > mx - 1 ||
+		   ex < 0 || ex > mx - 1 ||
+		   sy < 0 || sy > my - 1 ||
+		   ey < 0 || ey > my - 1){
+			printf("%d %d %d %d invalid\n", sx, sy, ex, ey);
+			continue;
+		}
+		xp = expansions;
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &q0);
+		#endif
+		solved = solve(ol);
+		if(solved < 0){
+			return 1;
+		}
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &q1);
+		timespec_diff(&q0, &q1, &t_diff);
+		t = t_diff.tv_sec + t_diff.tv_nsec / 1e9;
+		#else
+		t = 0;
+		#endif
+		if(reach){
+			printf("%d %d %d %d %s %llu %.9f\n", sx, sy, ex, ey,
+			       solved ? "reachable" : "unreachable", expansions - xp, t);
+		} else {
+			printf("%d %d %d %d %d %llu %.9f\n", sx, sy, ex, ey,
+			       solved ? plen : -1, expansions - xp, t);
+		}
+		if(!nq || t < tmin){
+			tmin = t;
+		}
+		if(t > tmax){
+			tmax = t;
+		}
+		ttot += t;
+		nq++;
+		if(solved){
+			ns++;
+			totlen += plen;
+		}
+		tot += expansions - xp;
+	}
+	fflush(stdout);
+	fprintf(stderr, "Queries        : %llu (%llu solved)\n", nq, ns);
+	if(nq){
+		fprintf(stderr, "Mean length    : %.1lf\n", ns ? (double) totlen / ns : 0.0);
+		fprintf(stderr, "Mean expansions: %.1lf\n", (double) tot / nq);
+		fprintf(stderr, "Query time     : %.9lf total, %.9lf mean, %.9lf min, %.9lf max\n",
+		        ttot, ttot / nq, tmin, tmax);
+		if(ttot > 0){
+			fprintf(stderr, "Queries/second : %.1lf\n", nq / ttot);
+		}
+	}
+	return 0;
+}
+
+static inline int lpa_get(int *a, size_t c){
+	return a[c] ? a[c] - 1 : LINF;
+}
+
+static inline void lpa_set(int *a, size_t c, int v){
+	a[c] = v == LINF ? 0 : v + 1;
+}
+
+// The cell next to cell c in direction d.
+static inline size_t lpa_step(size_t c, int d){
+	switch(d){
+		case 1:
+			return c - mx;
+		case 2:
+			return c + 1;
+		case 4:
+			return c + mx;
+		default:
+			return c - 1;
+	}
+}
+
+// The LPA* key of cell c, [min(g, rhs) + h, min(g, rhs)], packed so that the
+// keys compare as integers.
+static inline uint64_t lpa_key(size_t c){
+	int g = lpa_get(lg, c), r = lpa_get(lrhs, c);
+	int x = c % mx, y = c / mx;
+	if(r < g){
+		g = r;
+	}
+	if(g == LINF){
+		return UINT64_MAX;
+	}
+	return (uint64_t) (g + dist(x,y,sx,sy)) << 32 | (unsigned int) g;
+}
+
+static void lh_swap(size_t i, size_t j){
+	size_t   c = lhc[i];
+	uint64_t k = lhk[i];
+	lhc[i] = lhc[j];
+	lhk[i] = lhk[j];
+	lhc[j] = c;
+	lhk[j] = k;
+	lpos[lhc[i]] = i + 1;
+	lpos[lhc[j]] = j + 1;
+}
+
+static size_t lh_up(size_t i){
+	while(i > 0 && lhk[(i - 1) / 2] > lhk[i]){
+		lh_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	return i;
+}
+
+static void lh_down(size_t i){
+	size_t k;
+	while(2 * i + 1 < lhn){
+		k = 2 * i + 1;
+		if(k + 1 < lhn && lhk[k + 1] < lhk[k]){
+			k++;
+		}
+		if(lhk[i] <= lhk[k]){
+			break;
+		}
+		lh_swap(i, k);
+		i = k;
+	}
+}
+
+static void lh_insert(size_t c){
+	lhc[lhn] = c;
+	lhk[lhn] = lpa_key(c);
+	lpos[c]  = lhn + 1;
+	lh_up(lhn++);
+}
+
+static void lh_remove(size_t c){
+	size_t i = lpos[c] - 1;
+	lpos[c] = 0;
+	lhn--;
+	if(i != lhn){
+		lhc[i] = lhc[lhn];
+		lhk[i] = lhk[lhn];
+		lpos[lhc[i]] = i + 1;
+		lh_down(lh_up(i));
+	}
+}
+
+// Recomputes the rhs of cell c from its neighbours, as the edges around it
+// or their g have changed, and puts it on the open list if, and only if, it
+// is now inconsistent.
+static void lpa_update(size_t c){
+	int x = c % mx, y = c / mx;
+	int nb, d, g, r = LINF;
+	if(x != ex || y != ey){
+		nb = node_neighbors(x, y);
+		for(d = 1; d < 16; d <<= 1){
+			if(nb & d){
+				g = lpa_get(lg, lpa_step(c, d));
+				if(g != LINF && g + 1 < r){
+					r = g + 1;
+				}
+			}
+		}
+		lpa_set(lrhs, c, r);
+	}
+	if(lpos[c]){
+		lh_remove(c);
+	}
+	if(lpa_get(lg, c) != lpa_get(lrhs, c)){
+		lh_insert(c);
+	}
+}
+
+// Expands inconsistent cells, least key first, until the start's distance is
+// settled. Returns it, -1 if the start cannot be reached.
+static int lpa_compute(void){
+	size_t s = (size_t) sy * mx + sx, c;
+	int nb, d;
+	while(lhn && (lhk[0] < lpa_key(s) || lpa_get(lg, s) != lpa_get(lrhs, s))){
+		c = lhc[0];
+		lh_remove(c);
+		lexp++;
+		if(lpa_get(lg, c) > lpa_get(lrhs, c)){
+			lpa_set(lg, c, lpa_get(lrhs, c));
+		} else {
+			lpa_set(lg, c, LINF);
+			lpa_update(c);
+		}
+		nb = node_neighbors(c % mx, c / mx);
+		for(d = 1; d < 16; d <<= 1){
+			if(nb & d){
+				lpa_update(lpa_step(c, d));
+			}
+		}
+	}
+	return lpa_get(lg, s) == LINF ? -1 : lpa_get(lg, s);
+}
+
+// Leaves the path of the last lpa_compute() in the nodes' parents, as the
+// searches do, stepping from the start to the neighbour with the least g
+// each time. Returns 1 if there is a path, 0 if not and -1 if the g-scores
+// do not lead to the end in as many steps as the start's g says.
+static int lpa_path(void){
+	size_t c = (size_t) sy * mx + sx;
+	int g = lpa_get(lg, c), nb, d, bd, bg, ng;
+	int steps = 0;
+	if(g == LINF){
+		return 0;
+	}
+	next_epoch();
+	while(c != (size_t) ey * mx + ex){
+		nb = node_neighbors(c % mx, c / mx);
+		bd = 0;
+		bg = LINF;
+		for(d = 1; d < 16; d <<= 1){
+			if(nb & d && (ng = lpa_get(lg, lpa_step(c, d))) < bg){
+				bd = d;
+				bg = ng;
+			}
+		}
+		if(!bd || ++steps > g){
+			fprintf(stderr, "LPA*'s distances lead nowhere from (%d, %d).\n", (int) (c % mx), (int) (c / mx));
+			return -1;
+		}
+		set_parent(c % mx, c / mx, bd);
+		c = lpa_step(c, bd);
+	}
+	plen = steps;
+	return 1;
+}
+
+// Reads and makes the wall edits of ef up to the next "solve" line, putting
+// the cells on both sides of each edited wall up for repair. Returns the
+// number of edits made, and sets *eof at the end of ef.
+static int read_edits(FILE *ef, int *eof){
+	char line[256], dc, what[8];
+	int x, y, d, nx, ny, n = 0;
+	size_t c;
+	*eof = 1;
+	while(fgets(line, sizeof(line), ef) != NULL){
+		if(line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)){
+			continue;
+		}
+		if(!strncmp(line, "solve", 5) && strspn(line + 5, " \t\r\n") == strlen(line + 5)){
+			*eof = 0;
+			break;
+		}
+		if(sscanf(line, "%d %d %c %7s", &x, &y, &dc, what) != 4 ||
+		   (strcmp(what, "open") && strcmp(what, "close"))){
+			fprintf(stderr, "Malformed edit: %s", line);
+			continue;
+		}
+		switch(dc){
+			case 'U':
+				d  = 1;
+				nx = x;
+				ny = y - 1;
+				break;
+			case 'R':
+				d  = 2;
+				nx = x + 1;
+				ny = y;
+				break;
+			case 'D':
+				d  = 4;
+				nx = x;
+				ny = y + 1;
+				break;
+			case 'L':
+				d  = 8;
+				nx = x - 1;
+				ny = y;
+				break;
+			default:
+				fprintf(stderr, "Malformed edit: %s", line);
+				continue;
+		}
+		if(x < 0 || x > mx - 1 || y < 0 || y > my - 1 ||
+		   nx < 0 || nx > mx - 1 || ny < 0 || ny > my - 1){
+			fprintf(stderr, "Edit off the edge of the maze: %s", line);
+			continue;
+		}
+		if(what[0] == 'o'){
+			add_neighbors(x , y , d);
+			add_neighbors(nx, ny, ((d << 2) | (d >> 2)) & 15);
+		} else {
+			clear_neighbors(x , y , d);
+			clear_neighbors(nx, ny, ((d << 2) | (d >> 2)) & 15);
+		}
+		c = (size_t) y * mx + x;
+		lpa_update(c);
+		lpa_update(lpa_step(c, d));
+		n++;
+	}
+	return n;
+}
+
+// Solves the maze with LPA*, then repairs the path after each batch of wall
+// edits from ef, and at the end leaves the path of the last batch in the
+// nodes as the searches do. With everify every batch is also solved from
+// scratch with solve(), both to check the repair and to show what it saved.
+// Returns 1 if there is a path, 0 if not and -1 on failure.
+int run_edits(FILE *ef, openlist ol[2]){
+	size_t cells = (size_t) mx * my;
+	int nb, ne, tne = 0, eof = 0, len, full = 0, solved;
+	unsigned long long int xp, rx, fx, trx = 0, tfx = 0;
+	double rt, ft, trt = 0, tft = 0;
+	#ifdef DO_TIMING
+	struct timespec q0, q1;
+	#endif
+	if(cells >= UINT_MAX){
+		fprintf(stderr, "The maze has too many cells for LPA*'s open list.\n");
+		return -1;
+	}
+	lg   = map_grid(cells * sizeof(int));
+	lrhs = map_grid(cells * sizeof(int));
+	lpos = map_grid(cells * sizeof(unsigned int));
+	lhc  = map_grid(cells * sizeof(size_t));
+	lhk  = map_grid(cells * sizeof(uint64_t));
+	if(lg == NULL || lrhs == NULL || lpos == NULL || lhc == NULL || lhk == NULL){
+		fprintf(stderr, "LPA* state mmap() failed (%m).\n");
+		return -1;
+	}
+	lpa_set(lrhs, (size_t) ey * mx + ex, 0);
+	lh_insert((size_t) ey * mx + ex);
+	fprintf(stderr, "Applying edits...\n");
+	for(nb = 0; !eof; nb++){
+		ne = nb ? read_edits(ef, &eof) : 0;
+		if(nb && eof && !ne){
+			break;
+		}
+		xp = lexp;
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &q0);
+		#endif
+		len = lpa_compute();
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &q1);
+		timespec_diff(&q0, &q1, &t_diff);
+		rt = t_diff.tv_sec + t_diff.tv_nsec / 1e9;
+		#else
+		rt = 0;
+		#endif
+		rx = lexp - xp;
+		if(!everify){
+			printf("%d %d %d %llu %.9f\n", nb, ne, len, rx, rt);
+			if(nb){
+				tne += ne;
+				trx += rx;
+				trt += rt;
+			}
+			continue;
+		}
+		xp = expansions;
+		solved = solve(ol);
+		if(solved < 0){
+			return -1;
+		}
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &q0);
+		timespec_diff(&q1, &q0, &t_diff);
+		ft = t_diff.tv_sec + t_diff.tv_nsec / 1e9;
+		#else
+		ft = 0;
+		#endif
+		fx = expansions - xp;
+		full = solved ? plen : -1;
+		if(len != full){
+			fprintf(stderr, "Batch %d: the repaired length %d is not the full search's %d.\n", nb, len, full);
+			return -1;
+		}
+		printf("%d %d %d %llu %llu %.9f %.9f\n", nb, ne, len, rx, fx, rt, ft);
+		if(nb){
+			tne += ne;
+			trx += rx;
+			tfx += fx;
+			trt += rt;
+			tft += ft;
+		}
+	}
+	fflush(stdout);
+	fprintf(stderr, "Repairs        : %d (%d edits)\n", nb - 1, tne);
+	if(nb > 1 && everify){
+		fprintf(stderr, "Expansions     : %llu repairing, %llu from scratch (%.2lf%%)\n",
+		        trx, tfx, tfx ? 100.0 * trx / tfx : 0.0);
+		fprintf(stderr, "Repair time    : %.9lf, %.9lf from scratch\n", trt, tft);
+	} else
+	if(nb > 1){
+		fprintf(stderr, "Expansions     : %llu repairing\n", trx);
+		fprintf(stderr, "Repair time    : %.9lf\n", trt);
+	}
+	solved = lpa_path();
+	munmap(lg  , cells * sizeof(int));
+	munmap(lrhs, cells * sizeof(int));
+	munmap(lpos, cells * sizeof(unsigned int));
+	munmap(lhc , cells * sizeof(size_t));
+	munmap(lhk , cells * sizeof(uint64_t));
+	return solved;
+}
+
+// Reads the maze in fn into z for --serve, through the compact grid, and
+// keeps its neighbors.
+static int load_resident(char *fn, smaze *z){
+	FILE *in;
+	if(!strcmp(fn, "-")){
+		in = stdin;
+	} else {
+		in = fopen(fn, "r");
+	}
+	if(in == NULL){
+		fprintf(stderr, "fopen on '%s' failed (%m).\n", fn);
+		return 1;
+	}
+	in = open_compressed(in);
+	if(in == NULL){
+		return 1;
+	}
+	fprintf(stderr, "Loading '%s'... ", fn);
+	binary = 0;
+	if(read_dimensions(in) || alloc_maze() || (binary ? parse_binary(in) : parse_mapped(in))){
+		return 1;
+	}
+	munmap(cc, (size_t) mx * my);
+	z->name = fn;
+	z->mx   = mx;
+	z->my   = my;
+	z->cnr  = cnr;
+	z->cn   = cn;
+	cn = NULL;
+	cc = NULL;
+	if(in != stdin){
+		fclose(in);
+	}
+	return 0;
+}
+
+// Histogram bucket of a latency of v nanoseconds: four to each power of two,
+// so a bucket spans at most a quarter of its lower bound.
+static inline int lat_bucket(unsigned long long int v){
+	int b;
+	if(v < 8){
+		return v;
+	}
+	b = 63 - __builtin_clzll(v);
+	b = 4 * b + ((v >> (b - 2)) & 3);
+	return b < SLH ? b : SLH - 1;
+}
+
+// Lower bound of latency histogram bucket k, in nanoseconds.
+static inline unsigned long long int lat_lower(int k){
+	if(k < 8){
+		return k;
+	}
+	return (unsigned long long int) (4 + (k & 3)) << ((k >> 2) - 2);
+}
+
+static int sw_printf(sworker *w, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+// Appends to w's replies, growing their buffer as needed.
+static int sw_printf(sworker *w, const char *fmt, ...){
+	va_list ap;
+	int n;
+	char *nb;
+	while(1){
+		va_start(ap, fmt);
+		n = vsnprintf(w->wb + w->wn, w->wa - w->wn, fmt, ap);
+		va_end(ap);
+		if(n < 0){
+			return 1;
+		}
+		if((size_t) n < w->wa - w->wn){
+			w->wn += n;
+			return 0;
+		}
+		nb = realloc(w->wb, 2 * w->wa + n);
+		if(nb == NULL){
+			fprintf(stderr, "Reply buffer realloc() failed.\n");
+			return 1;
+		}
+		w->wb = nb;
+		w->wa = 2 * w->wa + n;
+	}
+}
+
+// Sends w's replies to fd. Returns 1 if the client has gone.
+static int sw_flush(sworker *w, int fd){
+	size_t o = 0;
+	ssize_t r;
+	while(o < w->wn){
+		r = send(fd, w->wb + o, w->wn - o, MSG_NOSIGNAL);
+		if(r < 0){
+			w->wn = 0;
+			return 1;
+		}
+		o += r;
+	}
+	w->wn = 0;
+	return 0;
+}
+
+static int sw_push(sworker *w, size_t c, int f){
+	int k = f & (BQR - 1);
+	size_t *nq;
+	if(w->bn[k] == w->ba[k]){
+		nq = realloc(w->bq[k], 2 * w->ba[k] * sizeof(size_t));
+		if(nq == NULL){
+			fprintf(stderr, "Bucket realloc failed.\n");
+			return 1;
+		}
+		w->bq[k]  = nq;
+		w->ba[k] *= 2;
+	}
+	w->bq[k][w->bn[k]++] = c;
+	return 0;
+}
+
+// Finds the shortest path from (sx, sy) to (ex, ey) in z as solve_compact()
+// does, but in w's own search state, so that workers never share anything
+// but the neighbors. Returns its length, -1 if there is none or -2 if the
+// open list could not grow, and leaves the parents in w->cc for the path.
+static int serve_solve(sworker *w, smaze *z, int sx, int sy, int ex, int ey, unsigned long long int *xp){
+	unsigned char *cc = w->cc;
+	size_t c, tc, n = 1;
+	int x, y, nb, k, d, f;
+	int nx = 0, ny = 0;
+	int g, tg;
+	unsigned char t;
+	while(w->nt){
+		cc[w->tl[--w->nt]] = 0;
+	}
+	for(k = 0; k < BQR; k++){
+		w->bn[k] = 0;
+	}
+	c = (size_t) ey * z->mx + ex;
+	f = dist(ex,ey,sx,sy);
+	cc[c] = CELL(0, 1, 0);
+	w->tl[w->nt++] = c;
+	if(sw_push(w, c, f)){
+		return -2;
+	}
+	while(n){
+		k = f & (BQR - 1);
+		if(!w->bn[k]){
+			f++;
+			continue;
+		}
+		n--;
+		c = w->bq[k][--w->bn[k]];
+		if(CS(cc[c]) & 2){
+			continue;
+		}
+		x = c % z->mx;
+		y = c / z->mx;
+		g = f - dist(x,y,sx,sy);
+		cc[c] = CELL(CP(cc[c]), 2, g);
+		(*xp)++;
+		
+		if(x == sx && y == sy){
+			return g;
+		}
+		
+		nb = (z->cn[(size_t) y * z->cnr + (x >> 1)] >> ((x & 1) << 2)) & 15;
+		for(k = 0; k < 4; k++){
+			d = 1 << k;
+			if(!(nb & d)){
+				continue;
+			}
+			switch(d){
+				case 1:
+					nx = x;
+					ny = y - 1;
+					break;
+				case 2:
+					nx = x + 1;
+					ny = y;
+					break;
+				case 4:
+					nx = x;
+					ny = y + 1;
+					break;
+				case 8:
+					nx = x - 1;
+					ny = y;
+					break;
+			}
+			tc = (size_t) ny * z->mx + nx;
+			t = cc[tc];
+			if(CS(t) & 2){
+				continue;
+			}
+			tg = g + 1;
+			if(CS(t) && ((CG(t) - tg) & 7) != 2){
+				continue;
+			}
+			if(!CS(t)){
+				w->tl[w->nt++] = tc;
+			}
+			cc[tc] = CELL((k + 2) & 3, 1, tg);
+			if(sw_push(w, tc, tg + dist(nx,ny,sx,sy))){
+				return -2;
+			}
+			n++;
+		}
+	}
+	return -1;
+}
+
+// Appends the steps of the path serve_solve() left in w->cc, from (sx, sy)
+// to (ex, ey), in the run-length format of --format=rle.
+static int serve_path(sworker *w, smaze *z, int sx, int sy, int ex, int ey){
+	static const char dc[4] = {'U', 'R', 'D', 'L'};
+	int x = sx, y = sy, d, ld = -1;
+	unsigned long long int run = 0;
+	while(x != ex || y != ey){
+		d = CP(w->cc[(size_t) y * z->mx + x]);
+		switch(d){
+			case 0:
+				y--;
+				break;
+			case 1:
+				x++;
+				break;
+			case 2:
+				y++;
+				break;
+			case 3:
+				x--;
+				break;
+		}
+		if(d != ld && run){
+			if(sw_printf(w, " %c%llu", dc[ld], run)){
+				return 1;
+			}
+			run = 0;
+		}
+		ld = d;
+		run++;
+	}
+	return run ? sw_printf(w, " %c%llu", dc[ld], run) : 0;
+}
+
+// Appends the counters and the latency histogram of all workers as a line of
+// JSON. The histogram lists the lower bound in microseconds and the count of
+// each bucket that is not empty.
+static int serve_stats(sworker *w){
+	unsigned long long int req = 0, sol = 0, inv = 0, xp = 0, lsum = 0, lmax = 0;
+	unsigned long long int lat[SLH], acc = 0;
+	static const double pq[4] = {0.5, 0.9, 0.99, 0.999};
+	static const char  *pn[4] = {"p50", "p90", "p99", "p999"};
+	int i, k, q = 0, first = 1;
+	int r = 0;
+	memset(lat, 0, sizeof(lat));
+	for(i = 0; i < nsw; i++){
+		pthread_mutex_lock(&sw[i].mu);
+		req  += sw[i].nreq;
+		sol  += sw[i].nsolved;
+		inv  += sw[i].ninvalid;
+		xp   += sw[i].nexp;
+		lsum += sw[i].lsum;
+		if(sw[i].lmax > lmax){
+			lmax = sw[i].lmax;
+		}
+		for(k = 0; k < SLH; k++){
+			lat[k] += sw[i].lat[k];
+		}
+		pthread_mutex_unlock(&sw[i].mu);
+	}
+	pthread_mutex_lock(&sqmu);
+	i = sconns;
+	pthread_mutex_unlock(&sqmu);
+	r |= sw_printf(w, "{\"workers\":%d,\"connections\":%d,\"requests\":%llu,\"solved\":%llu,"
+	                  "\"invalid\":%llu,\"expansions\":%llu,\"latency_us\":{\"mean\":%.3f",
+	               nsw, i, req, sol, inv, xp, req ? lsum / 1e3 / req : 0.0);
+	// A percentile is reported as the upper bound of the bucket it falls in,
+	// or the maximum if that is lower.
+	for(k = 0; k < SLH && q < 4; k++){
+		acc += lat[k];
+		while(q < 4 && req && acc >= pq[q] * req){
+			r |= sw_printf(w, ",\"%s\":%.3f", pn[q], (k + 1 < SLH && lat_lower(k + 1) < lmax ? lat_lower(k + 1) : lmax) / 1e3);
+			q++;
+		}
+	}
+	r |= sw_printf(w, ",\"max\":%.3f},\"histogram\":[", lmax / 1e3);
+	for(k = 0; k < SLH; k++){
+		if(lat[k]){
+			r |= sw_printf(w, "%s[%.3f,%llu]", first ? "" : ",", lat_lower(k) / 1e3, lat[k]);
+			first = 0;
+		}
+	}
+	r |= sw_printf(w, "]}\n");
+	return r;
+}
+
+// Answers one request line. Path queries are timed from when the line has
+// been read to when the reply is ready, and counted in w's histogram.
+static int serve_line(sworker *w, char *line){
+	smaze *z;
+	int v[5], n, i, mz = 0, pth = 0, len;
+	unsigned long long int xp = 0, ns;
+	struct timespec q0, q1;
+	char c;
+	line[strcspn(line, "\r")] = '\0';
+	if(strspn(line, " \t") == strlen(line)){
+		return 0;
+	}
+	if(!strcmp(line, "mazes")){
+		for(i = 0; i < nsm; i++){
+			if(sw_printf(w, "%s%d %s %d %d", i ? "; " : "", i, sm[i].name, sm[i].mx, sm[i].my)){
+				return 1;
+			}
+		}
+		return sw_printf(w, "\n");
+	}
+	if(!strcmp(line, "stats")){
+		return serve_stats(w);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &q0);
+	if(!strncmp(line, "path ", 5)){
+		pth = 1;
+		line += 5;
+	}
+	n = sscanf(line, "%d %d %d %d %d %c", &v[0], &v[1], &v[2], &v[3], &v[4], &c);
+	if(n != 4 && n != 5){
+		return sw_printf(w, "error malformed request\n");
+	}
+	if(n == 5){
+		mz = v[0];
+		memmove(v, v + 1, 4 * sizeof(int));
+		if(sw_printf(w, "%d ", mz)){
+			return 1;
+		}
+	}
+	if(sw_printf(w, "%d %d %d %d", v[0], v[1], v[2], v[3])){
+		return 1;
+	}
+	z = mz >= 0 && mz < nsm ? &sm[mz] : NULL;
+	if(z == NULL ||
+	   v[0] < 0 || v[0] > z->mx - 1 || v[2] < 0 || v[2] > z->mx - 1 ||
+	   v[1] < 0 || v[1] > z->my - 1 || v[3] < 0 || v[3] > z->my - 1){
+		pthread_mutex_lock(&w->mu);
+		w->ninvalid++;
+		pthread_mutex_unlock(&w->mu);
+		return sw_printf(w, " invalid\n");
+	}
+	len = serve_solve(w, z, v[0], v[1], v[2], v[3], &xp);
+	if(len < -1){
+		return sw_printf(w, " error out of memory\n");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &q1);
+	if(sw_printf(w, " %d %llu %.9f", len, xp,
+	             (q1.tv_sec - q0.tv_sec) + (q1.tv_nsec - q0.tv_nsec) / 1e9) ||
+	   (pth && len >= 0 && serve_path(w, z, v[0], v[1], v[2], v[3])) ||
+	   sw_printf(w, "\n")){
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &q1);
+	ns = (q1.tv_sec - q0.tv_sec) * 1000000000ull + q1.tv_nsec - q0.tv_nsec;
+	pthread_mutex_lock(&w->mu);
+	w->nreq++;
+	w->nsolved += len >= 0;
+	w->nexp += xp;
+	w->lsum += ns;
+	if(ns > w->lmax){
+		w->lmax = ns;
+	}
+	w->lat[lat_bucket(ns)]++;
+	pthread_mutex_unlock(&w->mu);
+	return 0;
+}
+
+// Answers the requests that have come in on connection c. The replies to
+// all the lines of one read are sent together, so that clients sending
+// several requests at once get their replies at once. Returns 1 once the
+// client has gone or broken the protocol, when c is to be closed.
+static int serve_conn(sworker *w, sconn *c){
+	ssize_t r;
+	char *p, *nl;
+	r = recv(c->fd, c->rb + c->have, SRB - c->have, MSG_DONTWAIT);
+	if(r <= 0){
+		return r == 0 || errno != EAGAIN;
+	}
+	c->have += r;
+	p = c->rb;
+	while((nl = memchr(p, '\n', c->rb + c->have - p)) != NULL){
+		*nl = '\0';
+		if(serve_line(w, p)){
+			return 1;
+		}
+		p = nl + 1;
+	}
+	c->have -= p - c->rb;
+	memmove(c->rb, p, c->have);
+	if(c->have == SRB){
+		sw_printf(w, "error request too long\n");
+		sw_flush(w, c->fd);
+		return 1;
+	}
+	return sw_flush(w, c->fd);
+}
+
+static void close_conn(sconn *c){
+	pthread_mutex_lock(&sqmu);
+	if(c->prev != NULL){
+		c->prev->next = c->next;
+	} else {
+		sconnl = c->next;
+	}
+	if(c->next != NULL){
+		c->next->prev = c->prev;
+	}
+	pthread_mutex_unlock(&sqmu);
+	close(c->fd);
+	free(c);
+}
+
+// Takes connections with requests off the queue until the server stops. A
+// connection is out of sep while it is queued or being answered, so that no
+// two workers ever take it at once, and goes back in to wait for its next
+// requests.
+static void *serve_worker(void *arg){
+	sworker *w = arg;
+	struct epoll_event ev;
+	sconn *c;
+	while(1){
+		pthread_mutex_lock(&sqmu);
+		while(!sqn && !sqstop){
+			pthread_cond_wait(&sqcv, &sqmu);
+		}
+		if(sqstop){
+			pthread_mutex_unlock(&sqmu);
+			return NULL;
+		}
+		c = sq[sqh];
+		sqh = (sqh + 1) % SQN;
+		sqn--;
+		pthread_cond_broadcast(&sqcv);
+		pthread_mutex_unlock(&sqmu);
+		ev.events   = EPOLLIN;
+		ev.data.ptr = c;
+		if(serve_conn(w, c) || epoll_ctl(sep, EPOLL_CTL_ADD, c->fd, &ev)){
+			close_conn(c);
+		}
+	}
+}
+
+static void serve_signal(int sig){
+	(void) sig;
+	serving = 0;
+}
+
+// Loads the mazes in fns and answers path queries about them on the Unix
+// socket sfn, with nthreads workers, until interrupted or terminated. Each
+// line a client sends is a request, answered by a line:
+//   [MAZE] SX SY EX EY       the request's numbers, then the length (-1 if
+//                            there is no path), the expansions and the
+//                            seconds the search took, as with --queries
+//   path [MAZE] SX SY EX EY  the same followed by the steps, as with
+//                            --format=rle
+//   mazes                    "INDEX NAME WIDTH HEIGHT" of each maze, split
+//                            by "; "
+//   stats                    the counters and latency histogram, as JSON
+// MAZE is the index of a maze in the order given, 0 if left out.
+int serve(char *sfn, int nf, char **fns){
+	struct sockaddr_un sa;
+	struct sigaction act;
+	struct stat st;
+	struct epoll_event ev, evs[SQN];
+	sconn *c;
+	size_t cells = 1;
+	int i, k, lfd, fd, ne;
+	unsigned long long int req = 0, inv = 0;
+	
+	if(strlen(sfn) >= sizeof(sa.sun_path)){
+		fprintf(stderr, "Socket path '%s' is too long.\n", sfn);
+		return 1;
+	}
+	compact = 1;
+	pick_parser();
+	nsm = nf;
+	sm = calloc(nsm, sizeof(smaze));
+	if(sm == NULL){
+		fprintf(stderr, "Maze table malloc() failed.\n");
+		return 1;
+	}
+	for(i = 0; i < nsm; i++){
+		if(load_resident(fns[i], &sm[i])){
+			return 1;
+		}
+		if((size_t) sm[i].mx * sm[i].my > cells){
+			cells = (size_t) sm[i].mx * sm[i].my;
+		}
+	}
+	
+	// The search state is mapped untouched, so each worker only ever takes
+	// the pages of it that its searches reached.
+	nsw = nthreads;
+	sw = calloc(nsw, sizeof(sworker));
+	if(sw == NULL){
+		fprintf(stderr, "Worker malloc() failed.\n");
+		return 1;
+	}
+	for(i = 0; i < nsw; i++){
+		sw[i].cc = map_grid(cells);
+		sw[i].tl = map_grid(cells * sizeof(size_t));
+		sw[i].wa = SRB;
+		sw[i].wb = malloc(sw[i].wa);
+		if(sw[i].cc == NULL || sw[i].tl == NULL || sw[i].wb == NULL){
+			fprintf(stderr, "Worker scratch allocation failed (%m).\n");
+			return 1;
+		}
+		for(k = 0; k < BQR; k++){
+			sw[i].ba[k] = HRI;
+			sw[i].bq[k] = malloc(HRI * sizeof(size_t));
+			if(sw[i].bq[k] == NULL){
+				fprintf(stderr, "Bucket malloc() failed.\n");
+				return 1;
+			}
+		}
+		pthread_mutex_init(&sw[i].mu, NULL);
+	}
+	
+	// A socket left behind by a server that is gone is replaced.
+	if(!stat(sfn, &st) && S_ISSOCK(st.st_mode)){
+		unlink(sfn);
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, sfn);
+	lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(lfd < 0 || bind(lfd, (struct sockaddr *) &sa, sizeof(sa)) || listen(lfd, SOMAXCONN)){
+		fprintf(stderr, "Listening on '%s' failed (%m).\n", sfn);
+		return 1;
+	}
+	sep = epoll_create1(0);
+	ev.events   = EPOLLIN;
+	ev.data.ptr = NULL;
+	if(sep < 0 || epoll_ctl(sep, EPOLL_CTL_ADD, lfd, &ev)){
+		fprintf(stderr, "epoll setup failed (%m).\n");
+		return 1;
+	}
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = serve_signal;
+	sigemptyset(&act.sa_mask);
+	sigaction(SIGINT , &act, NULL);
+	sigaction(SIGTERM, &act, NULL);
+	serving = 1;
+	
+	for(i = 0; i < nsw; i++){
+		if(pthread_create(&sw[i].tid, NULL, serve_worker, &sw[i])){
+			fprintf(stderr, "pthread_create() failed for worker %d.\n", i);
+			return 1;
+		}
+	}
+	fprintf(stderr, "Serving %d maze%s on '%s' (%d workers)...\n", nsm, nsm == 1 ? "" : "s", sfn, nsw);
+	
+	// New connections join the epoll set, and connections with requests to
+	// answer go on the queue for the workers.
+	while(serving){
+		ne = epoll_wait(sep, evs, SQN, -1);
+		for(i = 0; i < ne; i++){
+			if(evs[i].data.ptr == NULL){
+				fd = accept(lfd, NULL, NULL);
+				if(fd < 0){
+					continue;
+				}
+				c = malloc(sizeof(sconn));
+				if(c == NULL){
+					close(fd);
+					continue;
+				}
+				c->fd   = fd;
+				c->have = 0;
+				c->prev = NULL;
+				pthread_mutex_lock(&sqmu);
+				c->next = sconnl;
+				if(sconnl != NULL){
+					sconnl->prev = c;
+				}
+				sconnl = c;
+				sconns++;
+				pthread_mutex_unlock(&sqmu);
+				ev.events   = EPOLLIN;
+				ev.data.ptr = c;
+				if(epoll_ctl(sep, EPOLL_CTL_ADD, fd, &ev)){
+					close_conn(c);
+				}
+				continue;
+			}
+			c = evs[i].data.ptr;
+			epoll_ctl(sep, EPOLL_CTL_DEL, c->fd, NULL);
+			pthread_mutex_lock(&sqmu);
+			while(sqn == SQN){
+				pthread_cond_wait(&sqcv, &sqmu);
+			}
+			sq[(sqh + sqn) % SQN] = c;
+			sqn++;
+			pthread_cond_broadcast(&sqcv);
+			pthread_mutex_unlock(&sqmu);
+		}
+	}
+	
+	fprintf(stderr, "Shutting down...\n");
+	close(lfd);
+	unlink(sfn);
+	pthread_mutex_lock(&sqmu);
+	sqstop = 1;
+	pthread_cond_broadcast(&sqcv);
+	pthread_mutex_unlock(&sqmu);
+	for(i = 0; i < nsw; i++){
+		pthread_join(sw[i].tid, NULL);
+		req += sw[i].nreq;
+		inv += sw[i].ninvalid;
+	}
+	while(sconnl != NULL){
+		close_conn(sconnl);
+	}
+	close(sep);
+	fprintf(stderr, "Connections    : %llu\n", sconns);
+	fprintf(stderr, "Queries        : %llu answered, %llu invalid\n", req, inv);
+	sw[0].wn = 0;
+	if(!serve_stats(&sw[0])){
+		fprintf(stderr, "%.*s", (int) sw[0].wn, sw[0].wb);
+	}
+	for(i = 0; i < nsw; i++){
+		munmap(sw[i].cc, cells);
+		munmap(sw[i].tl, cells * sizeof(size_t));
+		free(sw[i].wb);
+		for(k = 0; k < BQR; k++){
+			free(sw[i].bq[k]);
+		}
+	}
+	for(i = 0; i < nsm; i++){
+		munmap(sm[i].cn, sm[i].cnr * sm[i].my);
+	}
+	free(sw);
+	free(sm);
+	return 0;
+}
+
+// Opens a scratch file in xdir, unlinked at once so that it goes away with
+// the process however that ends.
+static int xscratch(void){
+	char *fn = malloc(strlen(xdir) + 20);
+	int fd;
+	if(fn == NULL){
+		fprintf(stderr, "File name malloc() failed.\n");
+		return -1;
+	}
+	sprintf(fn, "%s/solvemaze.XXXXXX", xdir);
+	fd = mkstemp(fn);
+	if(fd < 0){
+		fprintf(stderr, "Creating a scratch file in '%s' failed (%m).\n", xdir);
+	} else {
+		unlink(fn);
+	}
+	free(fn);
+	return fd;
+}
+
+// pread() and pwrite() of all n bytes at off, counted in xrbytes and xwbytes.
+static int xpread(int fd, void *b, size_t n, uint64_t off){
+	ssize_t r;
+	xrbytes += n;
+	while(n){
+		r = pread(fd, b, n, off);
+		if(r <= 0){
+			fprintf(stderr, r ? "Reading a scratch file failed (%m).\n" :
+			                    "A scratch file ended prematurely.\n");
+			return 1;
+		}
+		b = (char *) b + r;
+		n -= r;
+		off += r;
+	}
+	return 0;
+}
+
+static int xpwrite(int fd, const void *b, size_t n, uint64_t off){
+	ssize_t r;
+	xwbytes += n;
+	while(n){
+		r = pwrite(fd, b, n, off);
+		if(r < 0){
+			fprintf(stderr, "Writing a scratch file failed (%m).\n");
+			return 1;
+		}
+		b = (const char *) b + r;
+		n -= r;
+		off += r;
+	}
+	return 0;
+}
+
+// The id of cell (x, y): its tile's number in the high bits and its place in
+// the tile, y * XT + x within it, in the low 2 * XTB.
+static inline uint64_t xid(int x, int y){
+	return ((uint64_t) ((size_t) (y >> XTB) * xtx + (x >> XTB)) << (2 * XTB))
+	     | (uint64_t) ((y & (XT - 1)) << XTB | (x & (XT - 1)));
+}
+
+static inline void xcell(uint64_t id, int *x, int *y){
+	uint64_t t = id >> (2 * XTB);
+	*x = (int) (t % xtx) << XTB | (int) (id & (XT - 1));
+	*y = (int) (t / xtx) << XTB | (int) ((id >> XTB) & (XT - 1));
+}
+
+// Writes out the row of tiles ty, parsed into xband, and clears it for the
+// next one.
+static int xflush(size_t ty){
+	if(xpwrite(xtf, xband, xtx * XTL, ty * xtx * XTL)){
+		return 1;
+	}
+	memset(xband, 0, xtx * XTL);
+	return 0;
+}
+
+// parse_row while tiling: parses row i into xband with the parser picked for
+// the CPU, and writes the tiles out once their last row is in.
+static void xtile_row(char *hl, char *ul, char *dl, int i){
+	xrow(hl, ul, dl, i);
+	if((i & (XT - 1)) == XT - 1 || i == my - 1){
+		xerr |= xflush(i >> XTB);
+	}
+}
+
+// Copies the maze into the tiles file, reading it as a stream a row at a
+// time, so that no more than a row of tiles of it is ever in memory.
+static int xtile_maze(FILE *in){
+	size_t rl = (mx + 3) / 4;
+	unsigned char *rb, *row, *prow = NULL;
+	int i;
+	if(!binary){
+		pick_parser();
+		xrow = parse_row;
+		parse_row = xtile_row;
+		i = parse_maze(in);
+		parse_row = xrow;
+		return i || xerr;
+	}
+	rb = malloc(2 * rl);
+	if(rb == NULL){
+		fprintf(stderr, "Row buffer malloc() failed.\n");
+		return 1;
+	}
+	for(i = 0; i < my; i++){
+		row = rb + (i & 1) * rl;
+		if(fread(row, 1, rl, in) != rl){
+			fprintf(stderr, "File ended prematurely.\n");
+			free(rb);
+			return 1;
+		}
+		parse_binary_row(row, prow, i);
+		if(((i & (XT - 1)) == XT - 1 || i == my - 1) && xflush(i >> XTB)){
+			free(rb);
+			return 1;
+		}
+		prow = row;
+	}
+	free(rb);
+	return 0;
+}
+
+// The nibbles of tile t, from the cache or read into it in place of the
+// tile used longest ago. NULL if it could not be read.
+static unsigned char *xget(size_t t){
+	int s = xslot[t];
+	if(s >= 0){
+		xhits++;
+		if(s != xhead){
+			xnext[xprev[s]] = xnext[s];
+			if(xnext[s] >= 0){
+				xprev[xnext[s]] = xprev[s];
+			} else {
+				xtail = xprev[s];
+			}
+			xprev[s] = -1;
+			xnext[s] = xhead;
+			xprev[xhead] = s;
+			xhead = s;
+		}
+		return xtc + (size_t) s * XTL;
+	}
+	xmisses++;
+	if(xcused < xcn){
+		s = xcused++;
+	} else {
+		s = xtail;
+		xslot[xtile[s]] = -1;
+		xtail = xprev[s];
+		if(xtail >= 0){
+			xnext[xtail] = -1;
+		} else {
+			xhead = -1;
+		}
+	}
+	if(xpread(xtf, xtc + (size_t) s * XTL, XTL, t * XTL)){
+		return NULL;
+	}
+	xslot[t] = s;
+	xtile[s] = t;
+	xprev[s] = -1;
+	xnext[s] = xhead;
+	if(xhead >= 0){
+		xprev[xhead] = s;
+	} else {
+		xtail = s;
+	}
+	xhead = s;
+	return xtc + (size_t) s * XTL;
+}
+
+// The neighbors of the cell with id c, -1 if its tile could not be read.
+static inline int xneighbors(uint64_t c){
+	unsigned char *tl = xget(c >> (2 * XTB));
+	if(tl == NULL){
+		return -1;
+	}
+	return (tl[(c & ((uint64_t) XT * XT - 1)) >> 1] >> ((c & 1) << 2)) & 15;
+}
+
+static void xs_init(xstream *s, int fd, uint64_t pos, uint64_t end){
+	s->fd  = fd;
+	s->pos = pos;
+	s->end = end;
+	s->n   = 0;
+	s->i   = 0;
+}
+
+// Makes sure the next id of a stream being read is in its buffer, at b[i].
+// Returns 1 if it is, 0 at the end of the stream and -1 on failure.
+static inline int xs_fill(xstream *s){
+	size_t k;
+	if(s->i < s->n){
+		return 1;
+	}
+	if(s->fd < 0 || s->pos == s->end){
+		return 0;
+	}
+	k = s->end - s->pos < XIOB ? s->end - s->pos : XIOB;
+	if(xpread(s->fd, s->b, k * sizeof(uint64_t), s->pos * sizeof(uint64_t))){
+		return -1;
+	}
+	s->pos += k;
+	s->n = k;
+	s->i = 0;
+	return 1;
+}
+
+// Skips the ids of a sorted stream below c, and returns whether c is next.
+static int xs_skip(xstream *s, uint64_t c){
+	int r;
+	while((r = xs_fill(s)) > 0 && s->b[s->i] < c){
+		s->i++;
+	}
+	return r > 0 ? s->b[s->i] == c : r;
+}
+
+static int xs_flush(xstream *s){
+	if(s->n && xpwrite(s->fd, s->b, s->n * sizeof(uint64_t), s->pos * sizeof(uint64_t))){
+		return 1;
+	}
+	s->pos += s->n;
+	s->n = 0;
+	return 0;
+}
+
+static inline int xs_put(xstream *s, uint64_t c){
+	if(s->n == XIOB && xs_flush(s)){
+		return 1;
+	}
+	s->b[s->n++] = c;
+	return 0;
+}
+
+// Sorts the n ids of a, with t as room for as many more, by radix on their
+// xbits bits, 11 at a time, and drops the duplicates. Returns how many are
+// left. The few neighbours of a narrow level are sorted by insertion.
+static size_t xsort(uint64_t *a, uint64_t *t, size_t n){
+	static size_t cnt[1 << 11];
+	uint64_t *p = a, *q = t, *w, c;
+	size_t k, j, o, s;
+	int sh;
+	if(n < 64){
+		for(k = 1; k < n; k++){
+			c = a[k];
+			for(j = k; j > 0 && a[j - 1] > c; j--){
+				a[j] = a[j - 1];
+			}
+			a[j] = c;
+		}
+	} else {
+		for(sh = 0; sh < xbits; sh += 11){
+			memset(cnt, 0, sizeof(cnt));
+			for(k = 0; k < n; k++){
+				cnt[(p[k] >> sh) & ((1 << 11) - 1)]++;
+			}
+			for(k = 0, o = 0; k < (1 << 11); k++){
+				s = cnt[k];
+				cnt[k] = o;
+				o += s;
+			}
+			for(k = 0; k < n; k++){
+				q[cnt[(p[k] >> sh) & ((1 << 11) - 1)]++] = p[k];
+			}
+			w = p;
+			p = q;
+			q = w;
+		}
+		if(p != a){
+			memcpy(a, p, n * sizeof(uint64_t));
+		}
+	}
+	for(k = 0, s = 0; k < n; k++){
+		if(!s || a[k] != a[s - 1]){
+			a[s++] = a[k];
+		}
+	}
+	return s;
+}
+
+// Sorts the n ids gathered in xrb and appends them to the runs file as run
+// *nr, whose end goes into (*ro)[*nr + 1].
+static int xspill(size_t *n, uint64_t **ro, size_t *nr, size_t *ar){
+	uint64_t *t;
+	*n = xsort(xrb, xrt, *n);
+	if(*nr + 2 > *ar){
+		*ar = *ar ? 2 * *ar : 16;
+		t = realloc(*ro, *ar * sizeof(uint64_t));
+		if(t == NULL){
+			fprintf(stderr, "Run list realloc() failed.\n");
+			return 1;
+		}
+		*ro = t;
+		if(!*nr){
+			t[0] = 0;
+		}
+	}
+	if(xpwrite(xrf, xrb, *n * sizeof(uint64_t), (*ro)[*nr] * sizeof(uint64_t))){
+		return 1;
+	}
+	(*ro)[*nr + 1] = (*ro)[*nr] + *n;
+	(*nr)++;
+	xruns++;
+	*n = 0;
+	return 0;
+}
+
+// Restores the order of the merge heap of streams below position i, by the
+// ids at their heads.
+static void xheap_down(xstream **hp, size_t nh, size_t i){
+	xstream *t;
+	size_t c;
+	while((c = 2 * i + 1) < nh){
+		if(c + 1 < nh && hp[c + 1]->b[hp[c + 1]->i] < hp[c]->b[hp[c]->i]){
+			c++;
+		}
+		if(hp[i]->b[hp[i]->i] <= hp[c]->b[hp[c]->i]){
+			break;
+		}
+		t = hp[i];
+		hp[i] = hp[c];
+		hp[c] = t;
+		i = c;
+	}
+}
+
+// Merges the nr sorted streams rs into out, keeping each id once, and with
+// prv and cur only if it is in neither of them. hp is room for the merge
+// heap. Returns the number of ids written, or -1 on failure, and sets
+// *found if the start is one of them.
+static long long int xmerge(xstream *rs, size_t nr, xstream **hp, xstream *out,
+                            xstream *prv, xstream *cur, int *found){
+	uint64_t c, sid = xid(sx, sy), last = UINT64_MAX;
+	size_t nh = 0, k;
+	long long int cnt = 0;
+	int r;
+	for(k = 0; k < nr; k++){
+		r = xs_fill(&rs[k]);
+		if(r < 0){
+			return -1;
+		}
+		if(r){
+			hp[nh++] = &rs[k];
+		}
+	}
+	for(k = nh / 2; k-- > 0;){
+		xheap_down(hp, nh, k);
+	}
+	while(nh){
+		c = hp[0]->b[hp[0]->i++];
+		r = xs_fill(hp[0]);
+		if(r < 0){
+			return -1;
+		}
+		if(!r){
+			hp[0] = hp[--nh];
+		}
+		xheap_down(hp, nh, 0);
+		if(c == last){
+			continue;
+		}
+		last = c;
+		if(prv != NULL && ((r = xs_skip(prv, c)) || (r = xs_skip(cur, c)))){
+			if(r < 0){
+				return -1;
+			}
+			continue;
+		}
+		if(xs_put(out, c)){
+			return -1;
+		}
+		if(c == sid && found != NULL){
+			*found = 1;
+		}
+		cnt++;
+	}
+	return xs_flush(out) ? -1 : cnt;
+}
+
+// Works out level t + 1 from level t, and t - 1 before it, and appends it to
+// the levels file. cur, prv and out are streams with buffers to use. Returns
+// the number of cells in it, or -1 on failure, and sets *found if the start
+// is one of them.
+// The runs are read through buffers in xrt, which is free once the last one
+// has been sorted, so at most xrn / XIOB of them are merged at once. With
+// more, they are first merged that many at a time into longer runs, written
+// after them in the runs file, until few enough are left.
+static long long int xlevel(size_t t, xstream *cur, xstream *prv, xstream *out, int *found){
+	uint64_t c;
+	uint64_t *ro = NULL, *no = NULL;
+	xstream *rs = NULL, **hp = NULL, w;
+	size_t fan = xrn / XIOB;
+	size_t n = 0, nr = 0, ar = 0, g, k, m;
+	long long int cnt = -1, wn;
+	int x, y, nb, r;
+	
+	// Gather the neighbours, spilling a sorted run whenever xrb fills.
+	xs_init(cur, xlf, xlo[t], xlo[t + 1]);
+	while((r = xs_fill(cur)) > 0){
+		c = cur->b[cur->i++];
+		nb = xneighbors(c);
+		if(nb < 0){
+			goto done;
+		}
+		expansions++;
+		if(n + 4 > xrn && xspill(&n, &ro, &nr, &ar)){
+			goto done;
+		}
+		xcell(c, &x, &y);
+		if(nb & 1){
+			xrb[n++] = xid(x, y - 1);
+		}
+		if(nb & 2){
+			xrb[n++] = xid(x + 1, y);
+		}
+		if(nb & 4){
+			xrb[n++] = xid(x, y + 1);
+		}
+		if(nb & 8){
+			xrb[n++] = xid(x - 1, y);
+		}
+	}
+	if(r < 0 || (nr && n && xspill(&n, &ro, &nr, &ar))){
+		goto done;
+	}
+	k = nr < 1 ? 1 : nr < fan ? nr : fan;
+	rs = malloc(k * sizeof(xstream));
+	hp = malloc(k * sizeof(xstream *));
+	if(rs == NULL || hp == NULL){
+		fprintf(stderr, "Run stream malloc() failed.\n");
+		goto done;
+	}
+	
+	// A level whose neighbours all fitted in xrb is merged from there.
+	if(!nr){
+		rs[0].b = xrb;
+		xs_init(&rs[0], -1, 0, 0);
+		rs[0].n = xsort(xrb, xrt, n);
+		nr = 1;
+	} else {
+		w.b = xrb;
+		while(nr > fan){
+			m = (nr + fan - 1) / fan;
+			no = malloc((m + 1) * sizeof(uint64_t));
+			if(no == NULL){
+				fprintf(stderr, "Run list malloc() failed.\n");
+				goto done;
+			}
+			no[0] = ro[nr];
+			for(g = 0; g < m; g++){
+				for(k = 0; k < fan && g * fan + k < nr; k++){
+					rs[k].b = xrt + k * XIOB;
+					xs_init(&rs[k], xrf, ro[g * fan + k], ro[g * fan + k + 1]);
+				}
+				xs_init(&w, xrf, no[g], 0);
+				wn = xmerge(rs, k, hp, &w, NULL, NULL, NULL);
+				if(wn < 0){
+					goto done;
+				}
+				no[g + 1] = no[g] + wn;
+			}
+			free(ro);
+			ro = no;
+			no = NULL;
+			nr = m;
+			xpasses++;
+		}
+		for(k = 0; k < nr; k++){
+			rs[k].b = xrt + k * XIOB;
+			xs_init(&rs[k], xrf, ro[k], ro[k + 1]);
+		}
+	}
+	
+	// Merge the runs into the next level, past the two levels before.
+	xs_init(prv, xlf, t ? xlo[t - 1] : 0, t ? xlo[t] : 0);
+	xs_init(cur, xlf, xlo[t], xlo[t + 1]);
+	xs_init(out, xlf, xlo[t + 1], 0);
+	cnt = xmerge(rs, nr, hp, out, prv, cur, found);
+	
+	done:
+	free(ro);
+	free(no);
+	free(rs);
+	free(hp);
+	return cnt;
+}
+
+// The breadth-first search of --external, from the end until it reaches the
+// start. Returns 1 if it does, setting plen, 0 if it cannot and -1 on
+// failure.
+static int xbfs(void){
+	uint64_t eid = xid(ex, ey), *t;
+	uint64_t *b = malloc(3 * XIOB * sizeof(uint64_t));
+	xstream cur, prv, out;
+	long long int n;
+	int found = sx == ex && sy == ey;
+	int r = -1;
+	if(b == NULL){
+		fprintf(stderr, "Stream buffer malloc() failed.\n");
+		return -1;
+	}
+	cur.b = b;
+	prv.b = b + XIOB;
+	out.b = b + 2 * XIOB;
+	xlo[0] = 0;
+	xlo[1] = 1;
+	xnl = 1;
+	xpeak = 1;
+	if(xpwrite(xlf, &eid, sizeof(eid), 0)){
+		goto done;
+	}
+	while(!found){
+		if(xnl + 2 > xal){
+			t = realloc(xlo, 2 * xal * sizeof(uint64_t));
+			if(t == NULL){
+				fprintf(stderr, "Level list realloc() failed.\n");
+				goto done;
+			}
+			xlo = t;
+			xal *= 2;
+		}
+		n = xlevel(xnl - 1, &cur, &prv, &out, &found);
+		if(n < 0){
+			goto done;
+		}
+		if(!n){
+			r = 0;
+			goto done;
+		}
+		xlo[xnl + 1] = xlo[xnl] + n;
+		xnl++;
+		if((unsigned long long int) n > xpeak){
+			xpeak = n;
+		}
+	}
+	plen = xnl - 1;
+	r = 1;
+	
+	done:
+	free(b);
+	return r;
+}
+
+// Whether id c is in the ids a to e of the levels file, which are sorted: -1
+// if they could not be read. The range is halved with single reads down to
+// a buffer's worth, which is read in one go.
+static int xfind(uint64_t c, uint64_t a, uint64_t e){
+	static uint64_t b[XIOB];
+	uint64_t w, h;
+	size_t lo, hi, k;
+	while(e - a > XIOB){
+		h = a + (e - a) / 2;
+		if(xpread(xlf, &w, sizeof(w), h * sizeof(w))){
+			return -1;
+		}
+		if(w == c){
+			return 1;
+		}
+		if(w < c){
+			a = h + 1;
+		} else {
+			e = h;
+		}
+	}
+	if(xpread(xlf, b, (e - a) * sizeof(uint64_t), a * sizeof(uint64_t))){
+		return -1;
+	}
+	for(lo = 0, hi = e - a; lo < hi;){
+		k = lo + (hi - lo) / 2;
+		if(b[k] < c){
+			lo = k + 1;
+		} else {
+			hi = k;
+		}
+	}
+	return lo < e - a && b[lo] == c;
+}
+
+// node_parent() for the path of --external: the direction from (x, y) to a
+// neighbour one level closer to the end. The path is walked from the start,
+// at level plen, so the level of the cell it has got to is kept in xplev.
+// Returns 0 if the levels could not be read, setting xerr.
+static int xparent(int x, int y){
+	int nb, d, r;
+	if(x == sx && y == sy){
+		xplev = plen;
+	}
+	nb = xneighbors(xid(x, y));
+	for(d = 1; nb > 0 && d < 16; d <<= 1){
+		if(!(nb & d)){
+			continue;
+		}
+		switch(d){
+			case 1:
+				r = xfind(xid(x, y - 1), xlo[xplev - 1], xlo[xplev]);
+				break;
+			case 2:
+				r = xfind(xid(x + 1, y), xlo[xplev - 1], xlo[xplev]);
+				break;
+			case 4:
+				r = xfind(xid(x, y + 1), xlo[xplev - 1], xlo[xplev]);
+				break;
+			default:
+				r = xfind(xid(x - 1, y), xlo[xplev - 1], xlo[xplev]);
+				break;
+		}
+		if(r < 0){
+			break;
+		}
+		if(r){
+			xplev--;
+			return d;
+		}
+	}
+	if(!xerr){
+		fprintf(stderr, "Could not find the way back from (%d, %d).\n", x, y);
+	}
+	xerr = 1;
+	return 0;
+}
+
+// Solves the maze of in, whose dimensions have been read, out of core, see
+// xdir, and reports on it like main() does for the other modes.
+int run_external(FILE *in){
+	openlist ol[2];
+	size_t nt;
+	int solved;
+	
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_dimensions);
+	#endif
+	xtx = ((size_t) mx + XT - 1) >> XTB;
+	xty = ((size_t) my + XT - 1) >> XTB;
+	nt  = xtx * xty;
+	for(xbits = 2 * XTB; (nt - 1) >> (xbits - 2 * XTB); xbits++);
+	// Half of the budget goes to the tile cache, and a quarter each to the
+	// run buffer and to the room for sorting it, which the buffers of the
+	// runs being merged then share, see xlevel().
+	xcn = ((size_t) xmem << 19) / XTL;
+	xcn = xcn < 1 ? 1 : xcn > nt ? nt : xcn;
+	xrn = ((size_t) xmem << 18) / sizeof(uint64_t);
+	xal = 1024;
+	xtc   = malloc(xcn * XTL);
+	xslot = malloc(nt * sizeof(int));
+	xtile = malloc(xcn * sizeof(size_t));
+	xprev = malloc(xcn * sizeof(int));
+	xnext = malloc(xcn * sizeof(int));
+	xrb   = malloc(xrn * sizeof(uint64_t));
+	xrt   = malloc(xrn * sizeof(uint64_t));
+	xlo   = malloc(xal * sizeof(uint64_t));
+	xband = calloc(xtx, XTL);
+	if(xtc == NULL || xslot == NULL || xtile == NULL || xprev == NULL || xnext == NULL ||
+	   xrb == NULL || xrt == NULL || xlo == NULL || xband == NULL){
+		fprintf(stderr, "External solver malloc() failed.\n");
+		return 1;
+	}
+	memset(xslot, -1, nt * sizeof(int));
+	xhead = -1;
+	xtail = -1;
+	if((xtf = xscratch()) < 0 || (xlf = xscratch()) < 0 || (xrf = xscratch()) < 0){
+		return 1;
+	}
+	
+	fprintf(stderr, "Tiling into %s (%zu x %zu tiles of %d x %d cells)...\n", xdir, xtx, xty, XT, XT);
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_malloc);
+	t_zero = t_malloc;
+	perf_mark(PM_ZERO);
+	#endif
+	if(xtile_maze(in)){
+		return 1;
+	}
+	free(xband);
+	xband = NULL;
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_parse);
+	perf_mark(PM_PARSE);
+	t_initheap = t_parse;
+	perf_mark(PM_CONTRACT);
+	perf_mark(PM_INITHEAP);
+	#endif
+	
+	fprintf(stderr, "Solving (%d, %d) -> (%d, %d) out of core (%zu tiles cached)...\n",
+	        sx, sy, ex, ey, xcn);
+	solved = xbfs();
+	if(solved < 0){
+		return 1;
+	}
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_solve);
+	perf_mark(PM_SOLVE);
+	#endif
+	if(!solved){
+		fprintf(stderr, "No path exists.\n");
+	} else {
+		fprintf(stderr, "Solved (length %d).\n", plen);
+		write_solution();
+		if(xerr){
+			return 1;
+		}
+	}
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_path);
+	perf_mark(PM_PATH);
+	#endif
+	
+	fprintf(stderr, "Tile cache     : %llu hits, %llu misses\n", xhits, xmisses);
+	fprintf(stderr, "Search levels  : %zu, widest %llu cells, %llu runs spilled, %llu merge passes\n",
+	        xnl, xpeak, xruns, xpasses);
+	fprintf(stderr, "Scratch I/O    : %.1f MiB read, %.1f MiB written\n",
+	        xrbytes / 1048576.0, xwbytes / 1048576.0);
+	#ifdef DO_TIMING
+	printdiff("get dimensions ", t_start     , t_dimensions);
+	printdiff("allocate memory", t_dimensions, t_malloc    );
+	printdiff("tile the maze  ", t_zero      , t_parse     );
+	printdiff("solve the maze ", t_initheap  , t_solve     );
+	printdiff("display results", t_solve     , t_path      );
+	printdiff("do everything  ", t_start     , t_path      );
+	#endif
+	memset(ol, 0, sizeof(ol));
+	print_stats(ol, solved);
+	
+	close(xtf);
+	close(xlf);
+	close(xrf);
+	free(xtc);
+	free(xslot);
+	free(xtile);
+	free(xprev);
+	free(xnext);
+	free(xrb);
+	free(xrt);
+	free(xlo);
+	if(in != stdin){
+		fclose(in);
+	}
+	return 0;
+}
+
+#ifdef DO_TIMING
+void timespec_diff(struct timespec *s, struct timespec *e, struct timespec *o){
+	if((e->tv_nsec - s->tv_nsec) < 0){
+		o->tv_sec  =              e->tv_sec  - s->tv_sec - 1;
+		o->tv_nsec = 1000000000 + e->tv_nsec - s->tv_nsec;
+	} else {
+		o->tv_sec  = e->tv_sec  - s->tv_sec;
+		o->tv_nsec = e->tv_nsec - s->tv_nsec;
+	}
+}
+#endif
+
+int read_dimensions(FILE *in){
+	int c = fgetc(in);
+	if(c == MAZB_MAGIC[0]){
+		unsigned char hdr[MAZB_HDRLEN];
+		unsigned int hv[3];
+		int k;
+		hdr[0] = c;
+		if(fread(hdr + 1, 1, MAZB_HDRLEN - 1, in) != MAZB_HDRLEN - 1){
+			fprintf(stderr, "File ended while reading the binary header.\n");
+			return 1;
+		}
+		if(memcmp(hdr, MAZB_MAGIC, 4)){
+			fprintf(stderr, "Bad magic in binary header.\n");
+			return 1;
+		}
+		for(k = 0; k < 3; k++){
+			hv[k] = (unsigned int) hdr[4 * k + 4]
+			      | (unsigned int) hdr[4 * k + 5] << 8
+			      | (unsigned int) hdr[4 * k + 6] << 16
+			      | (unsigned int) hdr[4 * k + 7] << 24;
+		}
+		if(hv[0] != MAZB_VERSION){
+			fprintf(stderr, "Unsupported binary format version %u.\n", hv[0]);
+			return 1;
+		}
+		if(hv[1] < 1 || hv[1] > 0x7fffffff || hv[2] < 1 || hv[2] > 0x7fffffff){
+			fprintf(stderr, "Dimension is too big! What are you thinking!?\n");
+			return 1;
+		}
+		mx = hv[1];
+		my = hv[2];
+		binary = 1;
+		return 0;
+	}
+	ungetc(c, in);
+	
+	char wstr[12], hstr[12];
+	int nstr = 0;
+	while(1){
+		c = fgetc(in);
+		if(c == EOF){
+			fprintf(stderr, "File ended while reading dimensions.\n");
+			return 1;
+		}
+		if(nstr == 12){
+			fprintf(stderr, "Dimension is too big! What are you thinking!?\n");
+			return 1;
+		}
+		if(c == ' '){
+			hstr[nstr] = '\0';
+			break;
+		}
+		hstr[nstr++] = c;
+	}
+	while(1){
+		c = fgetc(in);
+		if(c == EOF){
+			fprintf(stderr, "File ended while reading dimensions.\n");
+			return 1;
+		}
+		if(c != ' '){
+			break;
+		}
+	}
+	nstr = 0;
+	while(1){
+		if(c == EOF){
+			fprintf(stderr, "File ended while reading dimensions.\n");
+			return 1;
+		}
+		if(nstr == 12){
+			fprintf(stderr, "Dimension is too big! What are you thinking!?\n");
+			return 1;
+		}
+		if(c == '\n'){
+			wstr[nstr] = '\0';
+			break;
+		}
+		wstr[nstr++] = c;
+		c = fgetc(in);
+	}
+	
+	mx = atoi(wstr);
+	my = atoi(hstr);
+	return 0;
+}
+
+// Maps len bytes of zeroed memory for the grid. The kernel hands out zeroed
+// pages as they are first touched, by the parser, so the grid is never
+// cleared beforehand, and with MAP_NORESERVE a grid is only refused for lack
+// of memory once more of it is touched than there is room for. Huge pages
+// take most of the cost out of those first touches.
+static void *map_grid(size_t len){
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(p == MAP_FAILED){
+		return NULL;
+	}
+	#ifdef MADV_HUGEPAGE
+	madvise(p, len, MADV_HUGEPAGE);
+	#endif
+	return p;
+}
+
+int alloc_maze(void){
+	if(compact){
+		cnr = ((size_t) mx + 1) / 2;
+		fprintf(stderr, "mmap()'ing %llu bytes (%d rows x %llu bytes of neighbors + %d rows x %d bytes of state)...\n",
+		        (unsigned long long int) (cnr + mx) * my,
+		        my, (unsigned long long int) cnr, my, mx);
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_dimensions);
+		#endif
+		cn = map_grid(cnr * my);
+		cc = map_grid((size_t) mx * my);
+		if(cn == NULL || cc == NULL){
+			fprintf(stderr, "Compact grid mmap() failed (%m).\n");
+			return 1;
+		}
+		#ifdef DO_TIMING
+		clock_gettime(CLOCK_ID, &t_malloc);
+		#endif
+		return 0;
+	}
+	#ifdef LAYOUT_TILED
+	tpr = ((size_t) mx + TS - 1) >> TB;
+	size_t nt = tpr * (((size_t) my + TS - 1) >> TB);
+	fprintf(stderr, "mmap()'ing %llu bytes (%llu tiles x %d x %d nodes x %lu bytes per node)...\n",
+	        (unsigned long long int) (nt << (2 * TB)) * sizeof(node),
+	        (unsigned long long int) nt, TS, TS, sizeof(node));
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_dimensions);
+	#endif
+	mlen = (nt << (2 * TB)) * sizeof(node);
+	mt = map_grid(mlen);
+	if(mt == NULL){
+		fprintf(stderr, "Full mmap() failed (%m).\n");
+		return 1;
+	}
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_malloc);
+	#endif
+	return 0;
+	#else
+	int i;
+	unsigned long long int l = (unsigned long long int) my * sizeof(node *)
+	                         + (unsigned long long int) my * mx * sizeof(node);
+	if(l > 0xffffffffu && sizeof(size_t) == 4){
+		fprintf(stderr, "Size of malloc (0x%08llx,%08llx or 0d%llu bytes) "
+		                "overflows a 32 bit unsigned int (size_t).\n",
+		        l >> 32, l & 0xffffffffu, l);
+		return 1;
+	}
+	if(sizeof(node *) == 8){
+		fprintf(stderr, "mmap()'ing 0x%08llx,%08llx (0d%llu) bytes (%d rows x %d columns x %lu bytes per node + %d rows x %lu bytes per row pointer)...\n",
+		                l >> 32, l & 0xffffffffu, l,
+		                my, mx, sizeof(node), my, sizeof(node *));
+	} else {
+		fprintf(stderr, "mmap()'ing 0x%08llx (0d%llu) bytes (%d rows x %d columns x %lu bytes per node + %d rows x %lu bytes per row pointer)...\n",
+		                l, l,
+		                my, mx, sizeof(node), my, sizeof(node *));
+	}
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_dimensions);
+	#endif
+	
+	m = malloc(my * sizeof(node *));
+	if(m == NULL){
+		fprintf(stderr, "Initial malloc() failed (%m).\n");
+		return 1;
+	}
+	mlen = (size_t) my * mx * sizeof(node);
+	m[0] = map_grid(mlen);
+	if(m[0] == NULL){
+		fprintf(stderr, "Full mmap() failed (%m).\n");
+		return 1;
+	}
+	for(i = 1; i < my; i++){
+		m[i] = m[0] + (size_t) i * mx;
+	}
+	
+	#ifdef DO_TIMING
+	clock_gettime(CLOCK_ID, &t_malloc);
+	#endif
+	
+	return 0;
+	#endif
+}
+
+// Parses a text maze read as a stream, a line at a time, through
+// parse_row() like the mapped text, keeping the lines of vertical passages
+// above and below the current row of cells.
+int parse_maze(FILE *in){
+	size_t ll = 4 * mx - 2;
+	size_t r;
+	char *lb = malloc(3 * ll);
+	char *ul = NULL, *hl, *dl, *t;
+	int i, k;
+	if(lb == NULL){
+		fprintf(stderr, "Line buffer malloc() failed.\n");
+		return 1;
+	}
+	hl = lb;
+	dl = lb + ll;
+	t  = lb + 2 * ll;
+	for(i = 0; i < my; i++){
+		for(k = 0; k < 2 && (k == 0 || i < my - 1); k++){
+			r = fread(k ? dl : hl, 1, ll, in);
+			if(r < ll || (k ? dl : hl)[ll - 1] != '\n'){
+				fprintf(stderr, r < ll ? "File ended prematurely (%d bytes of line %d read).\n" :
+				                         "Line %d is not %d characters long.\n",
+				        r < ll ? (int) r : 2 * i + k + 2, r < ll ? 2 * i + k + 2 : (int) ll - 1);
+				free(lb);
+				return 1;
+			}
+		}
+		parse_row(hl, ul, i < my - 1 ? dl : NULL, i);
+		// The passages below this row are above the next one, and the
+		// buffer of the ones above it is free for the next row's cells.
+		t  = ul != NULL ? ul : t;
+		ul = dl;
+		dl = hl;
+		hl = t;
+	}
+	free(lb);
+	return 0;
+}
+
+// Maps the len bytes of in that follow what stdio has already read. Returns
+// NULL without complaint if in is not a regular file, so that the caller
+// can fall back to reading it as a stream. *maplen is set to what needs to
+// be munmap()ed afterwards.
+unsigned char *map_input(FILE *in, size_t len, size_t *maplen){
+	struct stat st;
+	long off = ftell(in);
+	unsigned char *map;
+	if(off < 0 || fstat(fileno(in), &st) || !S_ISREG(st.st_mode)){
+		return NULL;
+	}
+	if((size_t) st.st_size < off + len){
+		fprintf(stderr, "File ended prematurely (%lld bytes of %llu expected).\n",
+		        (long long) st.st_size, (unsigned long long) (off + len));
+		return MAP_FAILED;
+	}
+	*maplen = off + len;
+	map = mmap(NULL, *maplen, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+	if(map == MAP_FAILED){
+		fprintf(stderr, "mmap() of the maze failed (%m).\n");
+		return MAP_FAILED;
+	}
+	madvise(map, *maplen, MADV_SEQUENTIAL);
+	return map + off;
+}
+
+#ifdef HAVE_ZLIB
+// Inflates the next ZRB bytes of a gzip (or zlib) maze into out. Members of
+// a concatenated file decompress one after the other, as with gunzip.
+static int zr_gunzip(zring *z, unsigned char *out, size_t *n){
+	int ret;
+	z->zs.next_out  = out;
+	z->zs.avail_out = ZRB;
+	while(z->zs.avail_out > 0){
+		if(z->zs.avail_in == 0){
+			z->zs.next_in  = z->in;
+			z->zs.avail_in = fread(z->in, 1, ZRB, z->f);
+			if(z->zs.avail_in == 0){
+				*n = ZRB - z->zs.avail_out;
+				if(ferror(z->f) || !z->end){
+					fprintf(stderr, ferror(z->f) ? "Reading the compressed maze failed.\n" :
+					                               "The compressed maze is truncated.\n");
+					return -1;
+				}
+				return 1;
+			}
+		}
+		ret = inflate(&z->zs, Z_NO_FLUSH);
+		if(ret == Z_STREAM_END){
+			inflateReset(&z->zs);
+			z->end = 1;
+		} else if(ret == Z_OK){
+			z->end = 0;
+		} else {
+			fprintf(stderr, "Decompression failed (%s).\n", z->zs.msg != NULL ? z->zs.msg : "zlib error");
+			*n = ZRB - z->zs.avail_out;
+			return -1;
+		}
+	}
+	*n = ZRB;
+	return 0;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+// Decompresses the next ZRB bytes of a zstd maze into out. Once the input
+// has run out, a call that makes no progress tells whether the last frame
+// was complete.
+static int zr_unzstd(zring *z, unsigned char *out, size_t *n){
+	ZSTD_outBuffer zo = { out, ZRB, 0 };
+	size_t ret, p;
+	while(zo.pos < zo.size){
+		if(z->zi.pos == z->zi.size && !z->end){
+			z->zi.src  = z->in;
+			z->zi.pos  = 0;
+			z->zi.size = fread(z->in, 1, ZRB, z->f);
+			if(z->zi.size == 0){
+				if(ferror(z->f)){
+					fprintf(stderr, "Reading the compressed maze failed.\n");
+					*n = zo.pos;
+					return -1;
+				}
+				z->end = 1;
+			}
+		}
+		p = zo.pos;
+		ret = ZSTD_decompressStream(z->zd, &zo, &z->zi);
+		if(ZSTD_isError(ret)){
+			fprintf(stderr, "Decompression failed (%s).\n", ZSTD_getErrorName(ret));
+			*n = zo.pos;
+			return -1;
+		}
+		if(z->end && zo.pos == p){
+			*n = zo.pos;
+			if(ret){
+				fprintf(stderr, "The compressed maze is truncated.\n");
+				return -1;
+			}
+			return 1;
+		}
+	}
+	*n = ZRB;
+	return 0;
+}
+#endif
+
+// Fills the ring a buffer at a time, waiting whenever the parser is ZRN
+// buffers behind, until the maze ends or the ring is closed.
+static void *zr_thread(void *arg){
+	zring *z = arg;
+	unsigned char *out;
+	size_t n;
+	int r = 0;
+	while(!r){
+		pthread_mutex_lock(&z->mu);
+		while(z->filled - z->taken == ZRN && !z->closing){
+			pthread_cond_wait(&z->cv, &z->mu);
+		}
+		if(z->closing){
+			pthread_mutex_unlock(&z->mu);
+			break;
+		}
+		out = z->buf[z->filled % ZRN];
+		pthread_mutex_unlock(&z->mu);
+		r = z->fill(z, out, &n);
+		pthread_mutex_lock(&z->mu);
+		z->len[z->filled % ZRN] = n;
+		z->filled++;
+		z->done = r;
+		pthread_cond_broadcast(&z->cv);
+		pthread_mutex_unlock(&z->mu);
+	}
+	return NULL;
+}
+
+static ssize_t zr_read(void *cookie, char *b, size_t size){
+	zring *z = cookie;
+	size_t got = 0, n;
+	int k;
+	pthread_mutex_lock(&z->mu);
+	while(got < size){
+		while(z->taken == z->filled && !z->done){
+			pthread_cond_wait(&z->cv, &z->mu);
+		}
+		if(z->taken == z->filled){
+			break;
+		}
+		k = z->taken % ZRN;
+		n = z->len[k] - z->pos < size - got ? z->len[k] - z->pos : size - got;
+		pthread_mutex_unlock(&z->mu);
+		memcpy(b + got, z->buf[k] + z->pos, n);
+		pthread_mutex_lock(&z->mu);
+		got    += n;
+		z->pos += n;
+		if(z->pos == z->len[k]){
+			z->pos = 0;
+			z->taken++;
+			pthread_cond_broadcast(&z->cv);
+		}
+	}
+	n = got == 0 && z->done < 0;
+	pthread_mutex_unlock(&z->mu);
+	return n ? -1 : (ssize_t) got;
+}
+
+static int zr_close(void *cookie){
+	zring *z = cookie;
+	int k;
+	pthread_mutex_lock(&z->mu);
+	z->closing = 1;
+	pthread_cond_broadcast(&z->cv);
+	pthread_mutex_unlock(&z->mu);
+	pthread_join(z->tid, NULL);
+	#ifdef HAVE_ZLIB
+	if(z->fill == zr_gunzip){
+		inflateEnd(&z->zs);
+	}
+	#endif
+	#ifdef HAVE_ZSTD
+	if(z->fill == zr_unzstd){
+		ZSTD_freeDStream(z->zd);
+	}
+	#endif
+	if(z->f != stdin){
+		fclose(z->f);
+	}
+	for(k = 0; k < ZRN; k++){
+		free(z->buf[k]);
+	}
+	free(z->in);
+	free(z);
+	return 0;
+}
+
+// Returns in itself unless the maze in it is compressed with gzip or zstd,
+// in which case it returns a stream of the decompressed maze, or NULL if it
+// cannot be decompressed. Compressed mazes are neither mapped nor cached.
+FILE *open_compressed(FILE *in){
+	cookie_io_functions_t io = { zr_read, NULL, NULL, zr_close };
+	zring *z;
+	FILE *f;
+	int k, c = fgetc(in);
+	if(c != 0x1f && c != 0x28){
+		if(c != EOF){
+			ungetc(c, in);
+		}
+		return in;
+	}
+	#ifndef HAVE_ZLIB
+	if(c == 0x1f){
+		fprintf(stderr, "The maze is gzip-compressed, but solvemaze was built without zlib.\n");
+		return NULL;
+	}
+	#endif
+	#ifndef HAVE_ZSTD
+	if(c == 0x28){
+		fprintf(stderr, "The maze is zstd-compressed, but solvemaze was built without zstd.\n");
+		return NULL;
+	}
+	#endif
+	z = calloc(1, sizeof(zring));
+	if(z == NULL || (z->in = malloc(ZRB)) == NULL){
+		fprintf(stderr, "Decompression buffer malloc() failed.\n");
+		return NULL;
+	}
+	for(k = 0; k < ZRN; k++){
+		z->buf[k] = malloc(ZRB);
+		if(z->buf[k] == NULL){
+			fprintf(stderr, "Decompression buffer malloc() failed.\n");
+			return NULL;
+		}
+	}
+	// The byte already read is the first of the compressed input.
+	z->f = in;
+	z->in[0] = c;
+	#ifdef HAVE_ZLIB
+	if(c == 0x1f){
+		z->zs.next_in  = z->in;
+		z->zs.avail_in = 1;
+		if(inflateInit2(&z->zs, 15 + 32) != Z_OK){
+			fprintf(stderr, "inflateInit2() failed.\n");
+			return NULL;
+		}
+		z->fill = zr_gunzip;
+	}
+	#endif
+	#ifdef HAVE_ZSTD
+	if(c == 0x28){
+		z->zi.src  = z->in;
+		z->zi.size = 1;
+		z->zd = ZSTD_createDStream();
+		if(z->zd == NULL || ZSTD_isError(ZSTD_initDStream(z->zd))){
+			fprintf(stderr, "ZSTD_createDStream() failed.\n");
+			return NULL;
+		}
+		z->fill = zr_unzstd;
+	}
+	#endif
+	pthread_mutex_init(&z->mu, NULL);
+	pthread_cond_init(&z->cv, NULL);
+	if(pthread_create(&z->tid, NULL, zr_thread, z)){
+		fprintf(stderr, "pthread_create() failed for the decompression thread.\n");
+		return NULL;
+	}
+	f = fopencookie(z, "r", io);
+	if(f == NULL){
+		fprintf(stderr, "fopencookie() failed (%m).\n");
+		return NULL;
+	}
+	return f;
+}
+
+// Splits rows into one band per thread and runs fn on each, the last one on
+// the calling thread. Returns 1 if any band reported an error.
+int run_bands(int rows, void *(*fn)(void *), void *arg){
+	int t, nt = nthreads < rows ? nthreads : rows;
+	int err = 0;
+	if(nt < 1){
+		nt = 1;
+	}
+	pthread_t *tid = malloc(nt * sizeof(pthread_t));
+	band *b = malloc(nt * sizeof(band));
+	if(tid == NULL || b == NULL){
+		fprintf(stderr, "Band malloc() failed.\n");
+		return 1;
+	}
+	for(t = 0; t < nt; t++){
+		b[t].id  = t;
+		b[t].r0  = (long long int) rows *  t      / nt;
+		b[t].r1  = (long long int) rows * (t + 1) / nt;
+		b[t].arg = arg;
+		b[t].err = 0;
+	}
+	for(t = 0; t < nt - 1; t++){
+		if(pthread_create(&tid[t], NULL, fn, &b[t])){
+			fprintf(stderr, "pthread_create() failed, running band %d inline.\n", t);
+			fn(&b[t]);
+			tid[t] = pthread_self();
+		}
+	}
+	fn(&b[nt - 1]);
+	for(t = 0; t < nt - 1; t++){
+		if(!pthread_equal(tid[t], pthread_self())){
+			pthread_join(tid[t], NULL);
+		}
+	}
+	for(t = 0; t < nt; t++){
+		err |= b[t].err;
+	}
+	free(tid);
+	free(b);
+	return err;
+}
+
+// Fills in the neighbors of row i from its packed bits row and those of the
+// row above, prow (NULL for the first row).
+static void parse_binary_row(unsigned char *row, unsigned char *prow, int i){
+	int j;
+	int c, pc = 0;
+	char nb;
+	for(j = 0; j < mx; j++){
+		c = row[j >> 2] >> (2 * (j & 3));
+		nb = 0;
+		if((c & 1) && j < mx - 1){
+			nb |= 2;
+		}
+		if((c & 2) && i < my - 1){
+			nb |= 4;
+		}
+		if(pc & 1){
+			nb |= 8;
+		}
+		if(prow != NULL && (prow[j >> 2] >> (2 * (j & 3))) & 2){
+			nb |= 1;
+		}
+		add_neighbors(j, i, nb);
+		pc = c;
+	}
+}
+
+// Builds the neighbors of rows [r0, r1) from the packed bits. Each cell's
+// neighbors are assembled in one go: right and down from its own two bits,
+// left from the cell before it, up from the row above. Nothing is written
+// outside the band (the compact grid pads its rows to whole bytes for this),
+// so bands need no coordination.
+static void *parse_binary_band(void *arg){
+	band *b = arg;
+	unsigned char *bits = b->arg;
+	size_t rl = (mx + 3) / 4;
+	unsigned char *row;
+	int i;
+	for(i = b->r0; i < b->r1; i++){
+		row = bits + i * rl;
+		parse_binary_row(row, i > 0 ? row - rl : NULL, i);
+	}
+	return NULL;
+}
+
+int parse_binary(FILE *in){
+	size_t len = (size_t) (mx + 3) / 4 * my;
+	size_t maplen = 0;
+	unsigned char *bits = map_input(in, len, &maplen);
+	int r;
+	if(bits == MAP_FAILED){
+		return 1;
+	}
+	if(bits == NULL){
+		bits = malloc(len);
+		if(bits == NULL){
+			fprintf(stderr, "Bit buffer malloc() failed.\n");
+			return 1;
+		}
+		if(fread(bits, 1, len, in) != len){
+			fprintf(stderr, "File ended prematurely.\n");
+			free(bits);
+			return 1;
+		}
+		r = run_bands(my, parse_binary_band, bits);
+		free(bits);
+	} else {
+		r = run_bands(my, parse_binary_band, bits);
+		munmap(bits - (maplen - len), maplen);
+	}
+	return r;
+}
+
+// The portable version of parse_row(), a cell at a time from column j on.
+static void parse_row_plain(char *hl, char *ul, char *dl, int i, int j){
+	char nb;
+	for(; j < mx; j++){
+		nb = 0;
+		if(ul != NULL && ul[4 * j] == '.'){
+			nb |= 1;
+		}
+		if(j < mx - 1 && hl[4 * j + 2] == '.'){
+			nb |= 2;
+		}
+		if(dl != NULL && dl[4 * j] == '.'){
+			nb |= 4;
+		}
+		if(j > 0 && hl[4 * j - 2] == '.'){
+			nb |= 8;
+		}
+		add_neighbors(j, i, nb);
+	}
+}
+
+static void parse_row_scalar(char *hl, char *ul, char *dl, int i){
+	parse_row_plain(hl, ul, dl, i, 0);
+}
+
+// The vector versions compare 64 bytes of each line, 16 cells, with '.' at
+// once, giving masks with bit k set if byte k is. Cell k's openings are then
+// at bits 4k of the lines above and below and 4k + 2 of its own line, and
+// the one to its left at bit 4k - 2, so a few shifts and masks gather the 16
+// cells' neighbors into the nibbles of one word, the low one for the first
+// cell, as the compact grid keeps them (x86 being little-endian). Lines are
+// 4 * mx - 2 bytes long, so the last cells, whose bytes run into the next
+// line, are left to the portable version.
+static inline __attribute__((always_inline))
+void parse_row_masks(char *hl, char *ul, char *dl, int i, uint64_t (*mask)(const char *)){
+	uint64_t u, h, d, nb, ph = 0;
+	int j, k;
+	for(j = 0; 4 * j + 64 <= 4 * mx - 2; j += 16){
+		u = ul != NULL ? mask(ul + 4 * j) : 0;
+		h = mask(hl + 4 * j);
+		d = dl != NULL ? mask(dl + 4 * j) : 0;
+		nb = ( u       & 0x1111111111111111ULL) |
+		     ((h >> 1) & 0x2222222222222222ULL) |
+		     ((d << 2) & 0x4444444444444444ULL) |
+		     ((h << 5) & 0x8888888888888888ULL) |
+		     ((ph >> 59) & 8);
+		ph = h;
+		if(compact){
+			memcpy(cn + (size_t) i * cnr + (j >> 1), &nb, 8);
+		} else
+		if(xband != NULL){
+			memcpy(xband + xoff(j, i), &nb, 8);
+		} else {
+			for(k = 0; k < 16; k++){
+				add_neighbors(j + k, i, (nb >> (4 * k)) & 15);
+			}
+		}
+	}
+	parse_row_plain(hl, ul, dl, i, j);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static inline uint64_t dots_sse2(const char *p){
+	const __m128i dot = _mm_set1_epi8('.');
+	uint64_t r = 0;
+	int k;
+	for(k = 0; k < 4; k++){
+		r |= (uint64_t) (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(
+		         _mm_loadu_si128((const __m128i *) (p + 16 * k)), dot)) << (16 * k);
+	}
+	return r;
+}
+
+__attribute__((target("sse2")))
+static void parse_row_sse2(char *hl, char *ul, char *dl, int i){
+	parse_row_masks(hl, ul, dl, i, dots_sse2);
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t dots_avx2(const char *p){
+	const __m256i dot = _mm256_set1_epi8('.');
+	uint64_t lo = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+	                  _mm256_loadu_si256((const __m256i *)  p      ), dot));
+	uint64_t hi = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+	                  _mm256_loadu_si256((const __m256i *) (p + 32)), dot));
+	return lo | hi << 32;
+}
+
+__attribute__((target("avx2")))
+static void parse_row_avx2(char *hl, char *ul, char *dl, int i){
+	parse_row_masks(hl, ul, dl, i, dots_avx2);
+}
+#endif
+
+// Picks the fastest parse_row() the CPU can run.
+void pick_parser(void){
+	parse_row      = parse_row_scalar;
+	parse_row_name = "scalar";
+	#if defined(__x86_64__) || defined(__i386__)
+	if(__builtin_cpu_supports("avx2")){
+		parse_row      = parse_row_avx2;
+		parse_row_name = "avx2";
+	} else
+	if(__builtin_cpu_supports("sse2")){
+		parse_row      = parse_row_sse2;
+		parse_row_name = "sse2";
+	}
+	#endif
+}
+
+// Builds the neighbors of rows [r0, r1) from the mapped text. Text lines are
+// all 4 * mx - 2 bytes long, newline included, so row i's line of cells and
+// the line of vertical passages below it start at lines 2i and 2i + 1. Like
+// parse_binary_band(), every cell is assembled from the text around it: the
+// line above the band's first row belongs to the previous band and is only
+// read, so bands never write to the same node.
+static void *parse_text_band(void *arg){
+	band *b = arg;
+	char *text = b->arg;
+	size_t ll = 4 * mx - 2;
+	char *hl, *ul, *dl;
+	int i;
+	for(i = b->r0; i < b->r1; i++){
+		hl = text + 2 * i * ll;
+		ul = i > 0      ? hl - ll : NULL;
+		dl = i < my - 1 ? hl + ll : NULL;
+		if(hl[ll - 1] != '\n' || (dl != NULL && dl[ll - 1] != '\n')){
+			fprintf(stderr, "Line %d is not %d characters long.\n",
+			        2 * i + 2 + (hl[ll - 1] == '\n'), (int) ll - 1);
+			b->err = 1;
+			return NULL;
+		}
+		parse_row(hl, ul, dl, i);
+	}
+	return NULL;
+}
+
+// Parses a text maze through a mapping of the file, split into row bands
+// across nthreads threads. Streams that cannot be mapped go to parse_maze().
+int parse_mapped(FILE *in){
+	size_t len = (size_t) (4 * mx - 2) * (2 * my - 1);
+	size_t maplen = 0;
+	char *text = (char *) map_input(in, len, &maplen);
+	int r;
+	if(text == MAP_FAILED){
+		return 1;
+	}
+	if(text == NULL){
+		return parse_maze(in);
+	}
+	r = run_bands(my, parse_text_band, text);
+	munmap(text - (maplen - len), maplen);
+	return r;
+}
+
+// Parses the mapped text maze pbench times with each version of
+// parse_row() the CPU can run, from a cleared grid, and reports the best
+// bandwidth of each and a checksum of the neighbors it built, which should
+// all be the same.
+int parse_bench(FILE *in){
+	#ifdef DO_TIMING
+	size_t len = (size_t) (4 * mx - 2) * (2 * my - 1);
+	size_t maplen = 0;
+	char *text = (char *) map_input(in, len, &maplen);
+	struct timespec t0, t1;
+	double t, best;
+	unsigned int sum;
+	int v, r, i, j;
+	void (*rows[3])(char *, char *, char *, int) = {parse_row_scalar};
+	const char *names[3] = {"scalar"};
+	int nv = 1;
+	if(text == MAP_FAILED){
+		return 1;
+	}
+	if(text == NULL){
+		fprintf(stderr, "The benchmark needs a text maze it can map.\n");
+		return 1;
+	}
+	#if defined(__x86_64__) || defined(__i386__)
+	if(__builtin_cpu_supports("sse2")){
+		rows[nv]    = parse_row_sse2;
+		names[nv++] = "sse2";
+	}
+	if(__builtin_cpu_supports("avx2")){
+		rows[nv]    = parse_row_avx2;
+		names[nv++] = "avx2";
+	}
+	#endif
+	fprintf(stderr, "Benchmarking the parser, %d rounds of %.1lf MB (%d threads)...\n",
+	        pbench, len / 1e6, nthreads);
+	for(v = 0; v < nv; v++){
+		parse_row = rows[v];
+		best = 0;
+		for(r = 0; r < pbench; r++){
+			if(compact){
+				memset(cn, 0, (size_t) cnr * my);
+			} else {
+				for(i = 0; i < my; i++){
+					for(j = 0; j < mx; j++){
+						NODE(j, i).neighbors = 0;
+					}
+				}
+			}
+			clock_gettime(CLOCK_ID, &t0);
+			if(run_bands(my, parse_text_band, text)){
+				return 1;
+			}
+			clock_gettime(CLOCK_ID, &t1);
+			t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+			if(r == 0 || t < best){
+				best = t;
+			}
+		}
+		sum = 0;
+		for(i = 0; i < my; i++){
+			for(j = 0; j < mx; j++){
+				sum = sum * 31 + node_neighbors(j, i);
+			}
+		}
+		printf("%-6s %8.3lf GB/s %12.9f s  checksum %08x\n", names[v], len / best / 1e9,
+		       best, sum);
+	}
+	munmap(text - (maplen - len), maplen);
+	return 0;
+	#else
+	fprintf(stderr, "The benchmark needs the timing this system does not have.\n");
+	return 1;
+	#endif
+}
+
+// A cell with a single opening that is neither the start nor the end cannot
+// be on the path between them.
+static inline int is_dead_end(int x, int y, int nb){
+	return nb && !(nb & (nb - 1)) && (x != sx || y != sy) && (x != ex || y != ey);
+}
+
+// Seals the dead ends found in rows [r0, r1), each followed by the cells
+// that sealing it turns into dead ends, wherever those are. Sealing a cell
+// can only make one more dead end, its one neighbour, so the worklist is just
+// the end of the chain being followed. Neighbors are only changed through
+// clear_neighbors(), so two bands may work on the same cells: whoever clears
+// a cell's last opening owns sealing it, and whoever turns a cell into a dead
+// end goes on to seal it.
+static void *fill_band(void *arg){
+	band *b = arg;
+	unsigned long long int *pruned = b->arg;
+	int i, j;
+	int x, y, nb, on;
+	int nx = 0, ny = 0;
+	for(i = b->r0; i < b->r1; i++){
+		for(j = 0; j < mx; j++){
+			x = j;
+			y = i;
+			while(1){
+				nb = clear_neighbors(x, y, 0);
+				if(!is_dead_end(x, y, nb) || !(clear_neighbors(x, y, nb) & nb)){
+					break;
+				}
+				pruned[b->id]++;
+				switch(nb){
+					case 1:
+						nx = x;
+						ny = y - 1;
+						break;
+					case 2:
+						nx = x + 1;
+						ny = y;
+						break;
+					case 4:
+						nx = x;
+						ny = y + 1;
+						break;
+					case 8:
+						nx = x - 1;
+						ny = y;
+						break;
+				}
+				nb = ((nb << 2) | (nb >> 2)) & 15;
+				on = clear_neighbors(nx, ny, nb);
+				if(!(on & nb) || !is_dead_end(nx, ny, on & ~nb)){
+					break;
+				}
+				x = nx;
+				y = ny;
+			}
+		}
+	}
+	return NULL;
+}
+
+// Dead-end filling: seals every cell that is, or through sealing becomes, a
+// dead end, so that the search only sees the corridors that can lead from
+// the start to the end. The search never goes down a sealed dead end, so the
+// path it finds is unchanged.
+int fill_dead_ends(void){
+	unsigned long long int *pruned = calloc(nthreads, sizeof(unsigned long long int));
+	unsigned long long int total = 0;
+	int t;
+	if(pruned == NULL){
+		fprintf(stderr, "Dead-end counter malloc() failed.\n");
+		return 1;
+	}
+	if(run_bands(my, fill_band, pruned)){
+		free(pruned);
+		return 1;
+	}
+	for(t = 0; t < nthreads; t++){
+		total += pruned[t];
+	}
+	fprintf(stderr, "Dead ends      : %llu cells filled (%8.4lf%%)\n",
+	        total, (double) total * 100 / ((double) mx * my));
+	free(pruned);
+	return 0;
+}
+
+// Finds the edges of the vertices in rows [r0, r1), the vertices having been
+// numbered already. Each band only writes to its own vertices' edge slots.
+static void *contract_band(void *arg){
+	band *b = arg;
+	int i, j, k, d, e;
+	int x, y, back;
+	node *n;
+	for(i = b->r0; i < b->r1; i++){
+		for(j = 0; j < mx; j++){
+			n = &NODE(j, i);
+			if(!n->neighbors || !is_stop(j, i, n->neighbors, 0)){
+				continue;
+			}
+			for(k = 0; k < 4; k++){
+				d = 1 << k;
+				e = 4 * n->hindex + k;
+				geto[e] = -1;
+				if(!(n->neighbors & d)){
+					continue;
+				}
+				x = j;
+				y = i;
+				gew[e]   = corridor(&x, &y, d, 0, &back, 0);
+				geto[e]  = NODE(x, y).hindex;
+				gback[e] = back;
+			}
+		}
+	}
+	return NULL;
+}
+
+static int alloc_graph(void){
+	gvx   = malloc(gnv * sizeof(int));
+	gvy   = malloc(gnv * sizeof(int));
+	geto  = malloc(4 * (size_t) gnv * sizeof(int));
+	gew   = malloc(4 * (size_t) gnv * sizeof(int));
+	gback = malloc(4 * (size_t) gnv);
+	if(gvx == NULL || gvy == NULL || geto == NULL || gew == NULL || gback == NULL){
+		fprintf(stderr, "Graph malloc() failed.\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Builds the junction graph: numbers the vertices in row order, then walks
+// the corridors leaving them, in row bands across nthreads threads. Isolated
+// cells are left out, as they have no edges.
+int contract_maze(void){
+	int i, j;
+	node *n;
+	gnv = 0;
+	for(i = 0; i < my; i++){
+		for(j = 0; j < mx; j++){
+			n = &NODE(j, i);
+			if(n->neighbors && is_stop(j, i, n->neighbors, 0)){
+				n->hindex = gnv++;
+			}
+		}
+	}
+	if(alloc_graph()){
+		return 1;
+	}
+	for(i = 0; i < my; i++){
+		for(j = 0; j < mx; j++){
+			n = &NODE(j, i);
+			if(n->neighbors && is_stop(j, i, n->neighbors, 0)){
+				gvx[n->hindex] = j;
+				gvy[n->hindex] = i;
+			}
+		}
+	}
+	return run_bands(my, contract_band, NULL);
+}
+
+// A checksum of the neighbors of every cell, FNV-1a over them row by row,
+// worked out once: neither contracting the maze nor building its clusters
+// changes them.
+static uint64_t maze_sum(void){
+	static uint64_t h;
+	static int done;
+	int x, y;
+	if(!done){
+		h = 0xcbf29ce484222325ULL;
+		for(y = 0; y < my; y++){
+			for(x = 0; x < mx; x++){
+				h = (h ^ node_neighbors(x, y)) * 0x100000001b3ULL;
+			}
+		}
+		done = 1;
+	}
+	return h;
+}
+
+// Fills in the header of a cache file of the maze read from in. Its size is
+// -1 if in is not a regular file, whose cache could not be checked.
+static void cache_header(FILE *in, ghdr *h, char *magic, unsigned int version, int param, int nv){
+	struct stat st;
+	memset(h, 0, sizeof(ghdr));
+	memcpy(h->magic, magic, 4);
+	h->version = version;
+	h->mx = mx;
+	h->my = my;
+	if(!fstat(fileno(in), &st) && S_ISREG(st.st_mode)){
+		h->size = st.st_size;
+	} else {
+		h->size = -1;
+	}
+	h->sum = maze_sum();
+	h->param = param;
+	h->nv    = nv;
+}
+
+// Reads the header of cache file cf into h, and returns 1 unless it was made
+// from the same maze with the same kind of header as want.
+static int cache_stale(FILE *cf, ghdr *want, ghdr *h){
+	return fread(h, sizeof(ghdr), 1, cf) != 1 ||
+	       memcmp(h->magic, want->magic, 4) || h->version != want->version ||
+	       h->mx != want->mx || h->my != want->my || h->param != want->param ||
+	       h->size != want->size || h->sum != want->sum;
+}
+
+// Reads the junction graph from gfn. Returns 1, quietly if the file does not
+// exist, when the graph has to be contracted instead.
+int load_graph(FILE *in, char *gfn){
+	ghdr h, fh;
+	int v;
+	FILE *gf = fopen(gfn, "r");
+	if(gf == NULL){
+		return 1;
+	}
+	cache_header(in, &h, MAZG_MAGIC, MAZG_VERSION, 0, 0);
+	if(h.size < 0){
+		fprintf(stderr, "The maze is not a regular file, not using graph file '%s'.\n", gfn);
+		fclose(gf);
+		return 1;
+	}
+	if(cache_stale(gf, &h, &fh)){
+		fprintf(stderr, "Graph file '%s' does not match the maze, ignoring it.\n", gfn);
+		fclose(gf);
+		return 1;
+	}
+	gnv = fh.nv;
+	fprintf(stderr, "Loading junction graph from '%s'...\n", gfn);
+	if(alloc_graph()){
+		fclose(gf);
+		return 1;
+	}
+	if(fread(gvx  , sizeof(int), gnv    , gf) != (size_t) gnv     ||
+	   fread(gvy  , sizeof(int), gnv    , gf) != (size_t) gnv     ||
+	   fread(geto , sizeof(int), 4 * (size_t) gnv, gf) != 4 * (size_t) gnv ||
+	   fread(gew  , sizeof(int), 4 * (size_t) gnv, gf) != 4 * (size_t) gnv ||
+	   fread(gback, 1          , 4 * (size_t) gnv, gf) != 4 * (size_t) gnv){
+		fprintf(stderr, "Graph file '%s' ended prematurely, ignoring it.\n", gfn);
+		fclose(gf);
+		free(gvx);
+		free(gvy);
+		free(geto);
+		free(gew);
+		free(gback);
+		return 1;
+	}
+	fclose(gf);
+	for(v = 0; v < gnv; v++){
+		NODE(gvx[v], gvy[v]).hindex = v;
+	}
+	return 0;
+}
+
+int save_graph(FILE *in, char *gfn){
+	ghdr h;
+	FILE *gf;
+	cache_header(in, &h, MAZG_MAGIC, MAZG_VERSION, 0, gnv);
+	if(h.size < 0){
+		fprintf(stderr, "The maze is not a regular file, not saving its graph.\n");
+		return 0;
+	}
+	gf = fopen(gfn, "w");
+	if(gf == NULL){
+		fprintf(stderr, "fopen on '%s' failed (%m).\n", gfn);
+		return 1;
+	}
+	if(fwrite(&h   , sizeof(ghdr), 1  , gf) != 1             ||
+	   fwrite(gvx  , sizeof(int), gnv , gf) != (size_t) gnv  ||
+	   fwrite(gvy  , sizeof(int), gnv , gf) != (size_t) gnv  ||
+	   fwrite(geto , sizeof(int), 4 * (size_t) gnv, gf) != 4 * (size_t) gnv ||
+	   fwrite(gew  , sizeof(int), 4 * (size_t) gnv, gf) != 4 * (size_t) gnv ||
+	   fwrite(gback, 1          , 4 * (size_t) gnv, gf) != 4 * (size_t) gnv ||
+	   fclose(gf)){
+		fprintf(stderr, "Writing graph file '%s' failed (%m).\n", gfn);
+		return 1;
+	}
+	fprintf(stderr, "Saved junction graph to '%s'.\n", gfn);
+	return 0;
+}
+
+// Whether (x, y) has an opening into another cluster.
+static inline int crosses(int x, int y){
+	int nb = NODE(x, y).neighbors;
+	return ((nb & 1) && y % HC == 0) || ((nb & 2) && x % HC == HC - 1) ||
+	       ((nb & 4) && y % HC == HC - 1) || ((nb & 8) && x % HC == 0);
+}
+
+static int alloc_hpa(void){
+	hcs   = malloc(((size_t) hncx * hncy + 1) * sizeof(int));
+	hx    = malloc(hn * sizeof(int));
+	hy    = malloc(hn * sizeof(int));
+	hes   = malloc((hn + 1) * sizeof(long long int));
+	hdeg  = malloc(hn * sizeof(int));
+	hpred = malloc(hn * sizeof(int));
+	hsd   = malloc(HC * HC * sizeof(int));
+	hed   = malloc(HC * HC * sizeof(int));
+	hq    = malloc(2 * HC * HC * sizeof(int));
+	if(hcs == NULL || hx == NULL || hy == NULL || hes == NULL || hdeg == NULL ||
+	   hpred == NULL || hsd == NULL || hed == NULL || hq == NULL){
+		fprintf(stderr, "HPA* malloc() failed.\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int alloc_hpa_edges(void){
+	het = malloc(hes[hn] * sizeof(int));
+	hew = malloc(hes[hn] * sizeof(int));
+	if(het == NULL || hew == NULL){
+		fprintf(stderr, "HPA* edge malloc() failed.\n");
+		return 1;
+	}
+	return 0;
+}
+
+void free_hpa(void){
+	free(hx);
+	free(hy);
+	free(hcs);
+	free(hes);
+	free(hdeg);
+	free(het);
+	free(hew);
+	free(hpred);
+	free(hsd);
+	free(hed);
+	free(hq);
+	hx = hy = hcs = hdeg = het = hew = hpred = hsd = hed = hq = NULL;
+	hes = NULL;
+}
+
+// Finds the edges of the abstract nodes of cluster rows [r0, r1), by an
+// in-cluster search from each. Each band only writes to its own nodes' edges.
+static void *hpa_band(void *arg){
+	band *b = arg;
+	int *d = malloc(HC * HC * sizeof(int));
+	int *q = malloc(HC * HC * sizeof(int));
+	int cx, cy, c, i, j, k, t;
+	int x, y;
+	long long int e;
+	if(d == NULL || q == NULL){
+		fprintf(stderr, "Cluster search malloc() failed.\n");
+		b->err = 1;
+		return NULL;
+	}
+	for(cy = b->r0; cy < b->r1; cy++){
+		for(cx = 0; cx < hncx; cx++){
+			c = cy * hncx + cx;
+			for(i = hcs[c]; i < hcs[c + 1]; i++){
+				x = hx[i];
+				y = hy[i];
+				e = hes[i];
+				cluster_bfs(x, y, d, q);
+				for(j = hcs[c]; j < hcs[c + 1]; j++){
+					if(d[cluster_cell(hx[j], hy[j])] > 0){
+						het[e] = j;
+						hew[e] = d[cluster_cell(hx[j], hy[j])];
+						e++;
+					}
+				}
+				for(k = 1; k < 16; k <<= 1){
+					if(!(NODE(x, y).neighbors & k)){
+						continue;
+					}
+					t = -1;
+					switch(k){
+						case 1:
+							if(y % HC == 0){
+								t = NODE(x, y - 1).hindex;
+							}
+							break;
+						case 2:
+							if(x % HC == HC - 1){
+								t = NODE(x + 1, y).hindex;
+							}
+							break;
+						case 4:
+							if(y % HC == HC - 1){
+								t = NODE(x, y + 1).hindex;
+							}
+							break;
+						case 8:
+							if(x % HC == 0){
+								t = NODE(x - 1, y).hindex;
+							}
+							break;
+					}
+					if(t >= 0){
+						het[e] = t;
+						hew[e] = 1;
+						e++;
+					}
+				}
+				hdeg[i] = e - hes[i];
+			}
+		}
+	}
+	free(d);
+	free(q);
+	return NULL;
+}
+
+// Builds the HPA* abstraction: numbers the abstract nodes cluster by cluster,
+// gives each room for an edge to every other node of its cluster and for its
+// (at most four) border crossings, then finds the edges in bands of cluster
+// rows across nthreads threads.
+int build_hpa(void){
+	int cx, cy, c, x, y;
+	int i, k;
+	hncx = (mx + HC - 1) / HC;
+	hncy = (my + HC - 1) / HC;
+	hn = 0;
+	for(y = 0; y < my; y++){
+		for(x = 0; x < mx; x++){
+			hn += crosses(x, y);
+		}
+	}
+	if(alloc_hpa()){
+		return 1;
+	}
+	hn = 0;
+	for(cy = 0; cy < hncy; cy++){
+		for(cx = 0; cx < hncx; cx++){
+			c = cy * hncx + cx;
+			hcs[c] = hn;
+			for(y = cy * HC; y < my && y < (cy + 1) * HC; y++){
+				for(x = cx * HC; x < mx && x < (cx + 1) * HC; x++){
+					if(crosses(x, y)){
+						hx[hn] = x;
+						hy[hn] = y;
+						NODE(x, y).hindex = hn++;
+					}
+				}
+			}
+		}
+	}
+	hcs[hncx * hncy] = hn;
+	hes[0] = 0;
+	for(c = 0; c < hncx * hncy; c++){
+		k = hcs[c + 1] - hcs[c];
+		for(i = hcs[c]; i < hcs[c + 1]; i++){
+			hes[i + 1] = hes[i] + k - 1 + 4;
+		}
+	}
+	if(alloc_hpa_edges()){
+		return 1;
+	}
+	return run_bands(hncy, hpa_band, NULL);
+}
+
+// Reads the HPA* abstraction from hfn. Returns 1, quietly if the file does
+// not exist, when it has to be built instead.
+int load_hpa(FILE *in, char *hfn){
+	ghdr h, fh;
+	size_t ncl;
+	int i;
+	FILE *hf = fopen(hfn, "r");
+	if(hf == NULL){
+		return 1;
 	}
-	#ifdef DO_TIMING
-	clock_gettime(CLOCK_ID, &t_dimensions);
-	#endif
-	
-	m = malloc(my * sizeof(node *));
-	if(m == NULL){
-		fprintf(stderr, "Initial malloc() failed (%m).\n");
+	cache_header(in, &h, MAZH_MAGIC, MAZH_VERSION, HC, 0);
+	if(h.size < 0){
+		fprintf(stderr, "The maze is not a regular file, not using HPA* file '%s'.\n", hfn);
+		fclose(hf);
 		return 1;
 	}
-	m[0] = malloc(my * mx * sizeof(node));
-	if(m[0] == NULL){
-		fprintf(stderr, "Full malloc() failed (%m).\n");
+	if(cache_stale(hf, &h, &fh)){
+		fprintf(stderr, "HPA* file '%s' does not match the maze, ignoring it.\n", hfn);
+		fclose(hf);
 		return 1;
 	}
-	for(i = 1; i < my; i++){
-		m[i] = m[0] + i * mx;
+	fprintf(stderr, "Loading HPA* clusters from '%s'...\n", hfn);
+	hn = fh.nv;
+	hncx = (mx + HC - 1) / HC;
+	hncy = (my + HC - 1) / HC;
+	ncl = (size_t) hncx * hncy;
+	if(alloc_hpa()){
+		fclose(hf);
+		return 1;
+	}
+	if(fread(hx  , sizeof(int), hn     , hf) != (size_t) hn     ||
+	   fread(hy  , sizeof(int), hn     , hf) != (size_t) hn     ||
+	   fread(hcs , sizeof(int), ncl + 1, hf) != ncl + 1         ||
+	   fread(hes , sizeof(long long int), hn + 1, hf) != (size_t) hn + 1 ||
+	   fread(hdeg, sizeof(int), hn     , hf) != (size_t) hn     ||
+	   alloc_hpa_edges() ||
+	   fread(het , sizeof(int), hes[hn], hf) != (size_t) hes[hn] ||
+	   fread(hew , sizeof(int), hes[hn], hf) != (size_t) hes[hn]){
+		fprintf(stderr, "HPA* file '%s' ended prematurely, ignoring it.\n", hfn);
+		fclose(hf);
+		free_hpa();
+		return 1;
+	}
+	fclose(hf);
+	for(i = 0; i < hn; i++){
+		NODE(hx[i], hy[i]).hindex = i;
 	}
-	
-	fprintf(stderr, "Zeroing out...\n");
-	#ifdef DO_TIMING
-	clock_gettime(CLOCK_ID, &t_malloc);
-	#endif
-	
-	memset(m[0], 0, my * mx * sizeof(node));
-	
 	return 0;
 }
 
-int parse_maze(FILE *in){
-	int i, j, r;
-	char *lbuf = malloc((4 * mx - 2) * sizeof(char));
-	if(lbuf == NULL){
-		fprintf(stderr, "Line buffer malloc() failed.\n");
+int save_hpa(FILE *in, char *hfn){
+	ghdr h;
+	size_t ncl = (size_t) hncx * hncy;
+	FILE *hf;
+	cache_header(in, &h, MAZH_MAGIC, MAZH_VERSION, HC, hn);
+	if(h.size < 0){
+		fprintf(stderr, "The maze is not a regular file, not saving its clusters.\n");
+		return 0;
+	}
+	hf = fopen(hfn, "w");
+	if(hf == NULL){
+		fprintf(stderr, "fopen on '%s' failed (%m), not saving the clusters.\n", hfn);
+		return 0;
+	}
+	if(fwrite(&h  , sizeof(ghdr), 1, hf) != 1                ||
+	   fwrite(hx  , sizeof(int), hn     , hf) != (size_t) hn ||
+	   fwrite(hy  , sizeof(int), hn     , hf) != (size_t) hn ||
+	   fwrite(hcs , sizeof(int), ncl + 1, hf) != ncl + 1     ||
+	   fwrite(hes , sizeof(long long int), hn + 1, hf) != (size_t) hn + 1 ||
+	   fwrite(hdeg, sizeof(int), hn     , hf) != (size_t) hn ||
+	   fwrite(het , sizeof(int), hes[hn], hf) != (size_t) hes[hn] ||
+	   fwrite(hew , sizeof(int), hes[hn], hf) != (size_t) hes[hn] ||
+	   fclose(hf)){
+		fprintf(stderr, "Writing HPA* file '%s' failed (%m).\n", hfn);
 		return 1;
 	}
-	for(i = 0; i < my - 1; i++){
-		r = fread(lbuf, sizeof(char), 4 * mx - 2, in);
-		lbuf[4 * mx - 3] = '\0';
-		if(r < 4 * mx - 2){
-			fprintf(stderr, "File ended prematurely (%d bytes of %d expected): '%s'.\n", r, 4 * mx + 1, lbuf);
-			return 1;
-		}
-		for(j = 0; j < mx - 1; j++){
-			if(lbuf[4 * j + 2] == '.'){
-				m[i][j    ].neighbors |= 2;
-				m[i][j + 1].neighbors |= 8;
-			}
-		}
-		r = fread(lbuf, sizeof(char), 4 * mx - 2, in);
-		lbuf[4 * mx - 3] = '\0';
-		if(r < 4 * mx - 2){
-			fprintf(stderr, "File ended prematurely (%d bytes of %d expected): '%s'.\n", r, 4 * mx + 1, lbuf);
-			return 1;
-		}
-		for(j = 0; j < mx; j++){
-			if(lbuf[4 * j] == '.'){
-				m[i    ][j].neighbors |= 4;
-				m[i + 1][j].neighbors |= 1;
-			}
-		}
+	fprintf(stderr, "Saved HPA* clusters to '%s'.\n", hfn);
+	return 0;
+}
+
+static void or_and_plain(uint64_t *dst, const uint64_t *a, const uint64_t *b, size_t n){
+	size_t i;
+	for(i = 0; i < n; i++){
+		dst[i] |= a[i] & b[i];
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void or_and_avx2(uint64_t *dst, const uint64_t *a, const uint64_t *b, size_t n){
+	size_t i;
+	__m256i va, vb, vd;
+	for(i = 0; i + 4 <= n; i += 4){
+		va = _mm256_loadu_si256((const __m256i *) (a + i));
+		vb = _mm256_loadu_si256((const __m256i *) (b + i));
+		vd = _mm256_loadu_si256((const __m256i *) (dst + i));
+		vd = _mm256_or_si256(vd, _mm256_and_si256(va, vb));
+		_mm256_storeu_si256((__m256i *) (dst + i), vd);
+	}
+	for(; i < n; i++){
+		dst[i] |= a[i] & b[i];
 	}
-	r = fread(lbuf, sizeof(char), 4 * mx - 2, in);
-	lbuf[4 * mx - 3] = '\0';
-	if(r < 4 * mx - 2){
-		fprintf(stderr, "File ended prematurely (%d bytes of %d expected): '%s'.\n", r, 4 * mx + 1, lbuf);
+}
+#endif
+
+// Builds the bitboards of the openings from the neighbors, and allocates the
+// rest of them.
+int bb_init(void){
+	size_t nw;
+	int x, y, nb;
+	bbw = ((size_t) mx + 63) / 64;
+	nw = (size_t) my * bbw;
+	bbr = calloc(nw, sizeof(uint64_t));
+	bbd = calloc(nw, sizeof(uint64_t));
+	bbv = calloc(nw, sizeof(uint64_t));
+	bbf = calloc(nw, sizeof(uint64_t));
+	bbn = calloc(nw, sizeof(uint64_t));
+	bb0 = calloc(nw, sizeof(uint64_t));
+	bb1 = calloc(nw, sizeof(uint64_t));
+	bbs = calloc(nw, sizeof(unsigned int));
+	bbl = malloc(nw * sizeof(size_t));
+	bbm = malloc(nw * sizeof(size_t));
+	if(bbr == NULL || bbd == NULL || bbv == NULL || bbf == NULL || bbn == NULL ||
+	   bb0 == NULL || bb1 == NULL || bbs == NULL || bbl == NULL || bbm == NULL){
+		fprintf(stderr, "Bitboard malloc() failed.\n");
 		return 1;
 	}
-	for(j = 0; j < mx - 1; j++){
-		if(lbuf[4 * j + 2] == '.'){
-			m[i][j    ].neighbors |= 2;
-			m[i][j + 1].neighbors |= 8;
+	for(y = 0; y < my; y++){
+		for(x = 0; x < mx; x++){
+			nb = node_neighbors(x, y);
+			if(nb & 2){
+				bbr[y * bbw + (x >> 6)] |= 1ULL << (x & 63);
+			}
+			if(nb & 4){
+				bbd[y * bbw + (x >> 6)] |= 1ULL << (x & 63);
+			}
 		}
 	}
-	free(lbuf);
+	or_and = or_and_plain;
+	#if defined(__x86_64__) || defined(__i386__)
+	if(__builtin_cpu_supports("avx2")){
+		or_and = or_and_avx2;
+	}
+	#endif
 	return 0;
 }
 
@@ -608,8 +6070,8 @@ void calc_results(int sx, int sy, int ex, int ey){
 	int x = sx;
 	int y = sy;
 	while(x != ex || y != ey){
-		m[y][x].state |= 4;
-		switch(m[y][x].parent){
+		mark_path(x, y);
+		switch(node_parent(x, y)){
 			case 1:
 				y--;
 				break;
@@ -624,17 +6086,18 @@ void calc_results(int sx, int sy, int ex, int ey){
 				break;
 		}
 	}
-	m[y][x].state |= 4;
-	int i, j;
+	mark_path(x, y);
+	int i, j, st;
 	for(i = 0; i < my; i++){
 		for(j = 0; j < mx; j++){
-			if(m[i][j].state & 4){
+			st = node_state(j, i);
+			if(st & 4){
 				sc[0]++;
 			} else
-			if(m[i][j].state & 2){
+			if(st & 2){
 				sc[1]++;
 			} else
-			if(m[i][j].state & 1){
+			if(st & 1){
 				sc[2]++;
 			} else {
 				sc[3]++;
@@ -647,7 +6110,14 @@ void calc_results(int sx, int sy, int ex, int ey){
 		nodecountlen++;
 	}
 	totalnodes = sc[0] + sc[1] + sc[2] + sc[3];
-	fprintf(stderr, "Heap swaps     : %u\n", hswaps);
+	if(stats_json){
+		// print_stats() reports them.
+		return;
+	}
+	fprintf(stderr, "Open list      : %s\n", qengine == OL_BUCKET ? "bucket" : "heap");
+	fprintf(stderr, "Heap swaps     : %llu\n", hswaps);
+	fprintf(stderr, "Expansions     : %llu\n", expansions);
+	fprintf(stderr, "Queue pushes   : %llu (%llu stale, %llu reallocs)\n", qpushes, qstale, qgrows);
 	fprintf(stderr, "Path      nodes: %*llu (%8.4lf%%)\n", nodecountlen, sc[0], (double) sc[0] * 100 / totalnodes);
 	fprintf(stderr, "Closed    nodes: %*llu (%8.4lf%%)\n", nodecountlen, sc[1], (double) sc[1] * 100 / totalnodes);
 	fprintf(stderr, "Open      nodes: %*llu (%8.4lf%%)\n", nodecountlen, sc[2], (double) sc[2] * 100 / totalnodes);
@@ -655,6 +6125,149 @@ void calc_results(int sx, int sy, int ex, int ey){
 	fprintf(stderr, "Total     nodes: %*llu (%8.4lf%%)\n", nodecountlen, totalnodes, 100.0);
 }
 
+// Prints a phase time as text, or keeps it for print_stats().
+void report_time(const char *name, struct timespec *d){
+	if(!stats_json){
+		fprintf(stderr, "Time to %s: %3ld.%09ld\n", name, d->tv_sec, d->tv_nsec);
+		return;
+	}
+	if(njt < 16){
+		jtname[njt] = name;
+		jtsec[njt++] = d->tv_sec + d->tv_nsec / 1e9;
+	}
+}
+
+// Opens the hardware counters of --perf on this process and the threads it
+// starts from now on, counting in user space only.
+void perf_open(void){
+	#ifdef HAVE_PERF
+	struct perf_event_attr a;
+	int k, open = 0;
+	for(k = 0; k < NPERF; k++){
+		memset(&a, 0, sizeof(a));
+		a.size = sizeof(a);
+		a.type = PERF_TYPE_HARDWARE;
+		a.inherit = 1;
+		a.exclude_kernel = 1;
+		a.exclude_hv = 1;
+		switch(k){
+			case 0:
+				a.config = PERF_COUNT_HW_CPU_CYCLES;
+				break;
+			case 1:
+				a.config = PERF_COUNT_HW_INSTRUCTIONS;
+				break;
+			case 2:
+				a.config = PERF_COUNT_HW_CACHE_MISSES;
+				break;
+			case 3:
+				a.type   = PERF_TYPE_HW_CACHE;
+				a.config = PERF_COUNT_HW_CACHE_DTLB |
+				           PERF_COUNT_HW_CACHE_OP_READ << 8 |
+				           PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+				break;
+		}
+		pfd[k] = syscall(__NR_perf_event_open, &a, 0, -1, -1, 0);
+		if(pfd[k] < 0){
+			fprintf(stderr, "perf_event_open() for %s failed (%m).\n", pnames[k]);
+		} else {
+			open++;
+		}
+	}
+	if(!open){
+		perf = 0;
+	}
+	#else
+	fprintf(stderr, "This system has no perf_event_open(), so I am not counting anything.\n");
+	perf = 0;
+	#endif
+}
+
+// Reads the counters at phase boundary p.
+void perf_mark(int p){
+	int k;
+	if(!perf){
+		return;
+	}
+	for(k = 0; k < NPERF; k++){
+		if(pfd[k] < 0 || read(pfd[k], &pm[p][k], sizeof(pm[p][k])) != sizeof(pm[p][k])){
+			pm[p][k] = 0;
+		}
+	}
+}
+
+// Prints what is left of the statistics: the memory high-water marks and
+// the counters of --perf as text, or, for --stats=json, everything, the
+// search counters, node counts and phase times included.
+void print_stats(openlist ol[2], int solved){
+	static const struct { const char *name; int p0, p1; } ph[4] = {
+		{"parse", PM_ZERO, PM_PARSE}, {"init_heap", PM_CONTRACT, PM_INITHEAP},
+		{"solve", PM_INITHEAP, PM_SOLVE}, {"display", PM_SOLVE, PM_PATH}};
+	int nph = batch || dfn != NULL ? 3 : 4;
+	unsigned long long int qbytes = ol_bytes(&ol[0]) + (bidir ? ol_bytes(&ol[1]) : 0);
+	struct rusage ru;
+	long rss = 0;
+	int i, k, c;
+	if(!getrusage(RUSAGE_SELF, &ru)){
+		rss = ru.ru_maxrss;
+	}
+	if(!stats_json){
+		fprintf(stderr, "Peak RSS       : %ld KiB\n", rss);
+		fprintf(stderr, "Open list peak : %llu entries, %llu bytes allocated\n", qpeak, qbytes);
+		for(i = 0; perf && i < nph; i++){
+			fprintf(stderr, "Counters %-9s: %llu cycles, %llu instructions, %llu cache misses, %llu dTLB misses\n",
+			        ph[i].name,
+			        pm[ph[i].p1][0] - pm[ph[i].p0][0], pm[ph[i].p1][1] - pm[ph[i].p0][1],
+			        pm[ph[i].p1][2] - pm[ph[i].p0][2], pm[ph[i].p1][3] - pm[ph[i].p0][3]);
+		}
+		return;
+	}
+	fprintf(stderr, "{\"width\":%d,\"height\":%d,\"start\":[%d,%d],\"end\":[%d,%d]", mx, my, sx, sy, ex, ey);
+	fprintf(stderr, ",\"mode\":\"%s\"", dfn != NULL ? "distance-field" : batch ? "queries" : "single");
+	if(!batch && dfn == NULL){
+		fprintf(stderr, ",\"solved\":%s,\"length\":%d", solved ? "true" : "false", solved && !reach ? plen : -1);
+	}
+	if(efn != NULL){
+		fprintf(stderr, ",\"lpa_expansions\":%llu", lexp);
+	}
+	fprintf(stderr, ",\"open_list\":{\"engine\":\"%s\",\"heap_swaps\":%llu,\"expansions\":%llu"
+	                ",\"pushes\":%llu,\"stale\":%llu,\"reallocs\":%llu,\"peak_entries\":%llu,\"bytes\":%llu}",
+	        qengine == OL_BUCKET ? "bucket" : "heap", hswaps, expansions,
+	        qpushes, qstale, qgrows, qpeak, qbytes);
+	if(sc[0] + sc[1] + sc[2] + sc[3]){
+		fprintf(stderr, ",\"nodes\":{\"path\":%llu,\"closed\":%llu,\"open\":%llu,\"unvisited\":%llu,\"total\":%llu}",
+		        sc[0], sc[1], sc[2], sc[3], sc[0] + sc[1] + sc[2] + sc[3]);
+	}
+	// Phase names as printed, "get dimensions " becoming "get_dimensions".
+	fprintf(stderr, ",\"phases\":{");
+	for(i = 0; i < njt; i++){
+		fprintf(stderr, "%s\"", i ? "," : "");
+		for(c = strlen(jtname[i]); c > 0 && jtname[i][c - 1] == ' '; c--);
+		for(k = 0; k < c; k++){
+			fputc(jtname[i][k] == ' ' ? '_' : jtname[i][k], stderr);
+		}
+		fprintf(stderr, "\":%.9f", jtsec[i]);
+	}
+	fprintf(stderr, "},\"peak_rss_kib\":%ld", rss);
+	if(perf){
+		fprintf(stderr, ",\"perf\":{");
+		for(i = 0; i < nph; i++){
+			fprintf(stderr, "%s\"%s\":{", i ? "," : "", ph[i].name);
+			for(k = 0; k < NPERF; k++){
+				if(pfd[k] < 0){
+					fprintf(stderr, "%s\"%s\":null", k ? "," : "", pnames[k]);
+				} else {
+					fprintf(stderr, "%s\"%s\":%llu", k ? "," : "", pnames[k],
+					        pm[ph[i].p1][k] - pm[ph[i].p0][k]);
+				}
+			}
+			fprintf(stderr, "}");
+		}
+		fprintf(stderr, "}");
+	}
+	fprintf(stderr, "}\n");
+}
+
 void print_graphic_solution(void){
 	char *reprs[16] = {"  ", "╵ ", "╶─", "└─",
 	                   "╷ ", "│ ", "┌─", "├─",
@@ -665,38 +6278,40 @@ void print_graphic_solution(void){
 	                   "╻ ", "┃ ", "┏━", "┣━",
 	                   "╸ ", "┛ ", "━━", "┻━",
 	                   "┓ ", "┫ ", "┳━", "╋━"};
-	int i, j;
+	int i, j, st, nb;
 	#ifdef FANCY_TERM
 	int cstate = 0;
 	#endif
 	for(i = 0; i < my; i++){
 		for(j = 0; j < mx; j++){
-			if(m[i][j].state & 4){
+			st = node_state(j, i);
+			nb = node_neighbors(j, i);
+			if(st & 4){
 				#ifdef FANCY_TERM
 				if(isttyo && cstate != 1){ printf("%s", tcolors[1]); cstate = 1; }
 				#endif
-				printf("%s", beprs[(int) m[i][j].neighbors]);
+				printf("%s", beprs[nb]);
 			} else
-			if(m[i][j].state & 2){
+			if(st & 2){
 				#ifdef FANCY_TERM
 				if(isttyo && cstate != 2){ printf("%s", tcolors[2]); cstate = 2; }
-				printf("%s", (isttyo ? beprs : reprs)[(int) m[i][j].neighbors]);
+				printf("%s", (isttyo ? beprs : reprs)[nb]);
 				#else
-				printf("%s", beprs[(int) m[i][j].neighbors]);
+				printf("%s", beprs[nb]);
 				#endif
 			} else
-			if(m[i][j].state & 1){
+			if(st & 1){
 				#ifdef FANCY_TERM
 				if(isttyo && cstate != 3){ printf("%s", tcolors[3]); cstate = 3; }
-				printf("%s", (isttyo ? beprs : reprs)[(int) m[i][j].neighbors]);
+				printf("%s", (isttyo ? beprs : reprs)[nb]);
 				#else
-				printf("%s", beprs[(int) m[i][j].neighbors]);
+				printf("%s", beprs[nb]);
 				#endif
 			} else {
 				#ifdef FANCY_TERM
 				if(isttyo && cstate != 0){ printf("%s", tcolors[0]); cstate = 0; }
 				#endif
-				printf("%s", reprs[(int) m[i][j].neighbors]);
+				printf("%s", reprs[nb]);
 			}
 		}
 		printf("\n");
@@ -711,27 +6326,294 @@ void print_graphic_solution(void){
 	#endif
 }
 
+static void ob_flush(obuf *o){
+	fwrite(o->b, 1, o->n, o->f);
+	o->n = 0;
+}
+
+static inline void ob_putc(obuf *o, char c){
+	if(o->n == OBUF){
+		ob_flush(o);
+	}
+	o->b[o->n++] = c;
+}
+
+static inline void ob_uint(obuf *o, unsigned long long int v){
+	char d[20];
+	int k = 0;
+	do {
+		d[k++] = '0' + v % 10;
+		v /= 10;
+	} while(v);
+	while(k){
+		ob_putc(o, d[--k]);
+	}
+}
+
+static void ob_le(obuf *o, unsigned long long int v, int bytes){
+	int k;
+	for(k = 0; k < bytes; k++){
+		ob_putc(o, v >> (8 * k));
+	}
+}
+
+// Takes a step from (x, y) along the path, returning its direction as the
+// index of its bit in neighbors: 0 up, 1 right, 2 down, 3 left. The path of
+// --external comes from its levels instead, and if they cannot be read the
+// walk is cut short at the end.
+static inline int path_step(int *x, int *y){
+	int p;
+	if(xdir != NULL){
+		p = xparent(*x, *y);
+		if(!p){
+			*x = ex;
+			*y = ey;
+			return 0;
+		}
+	} else {
+		p = node_parent(*x, *y);
+	}
+	switch(p){
+		case 1:
+			(*y)--;
+			return 0;
+		case 2:
+			(*x)++;
+			return 1;
+		case 4:
+			(*y)++;
+			return 2;
+		default:
+			(*x)--;
+			return 3;
+	}
+}
+
+// Writes the path from (sx, sy) to (ex, ey) to f in the format of pformat.
+// It only reads the parents, through node_parent(), so it works the same on
+// every grid.
 void print_solution(int sx, int sy, int ex, int ey, FILE *f){
+	static const char dc[4] = {'U', 'R', 'D', 'L'};
+	obuf *o = malloc(sizeof(obuf));
+	unsigned long long int steps = 0, run = 0;
 	int x = sx;
 	int y = sy;
-	while(x != ex || y != ey){
-		fprintf(f, "(%d, %d)\n", x, y);
-		switch(m[y][x].parent){
-			case 1:
-				y--;
-				break;
-			case 2:
-				x++;
-				break;
-			case 4:
-				y++;
-				break;
-			case 8:
-				x--;
-				break;
+	int d, ld = -1, k;
+	unsigned char acc = 0;
+	if(o == NULL){
+		fprintf(stderr, "Output buffer malloc() failed.\n");
+		return;
+	}
+	o->f = f;
+	o->n = 0;
+	switch(pformat){
+		case PF_COORDS:
+			while(1){
+				ob_putc(o, '(');
+				ob_uint(o, x);
+				ob_putc(o, ',');
+				ob_putc(o, ' ');
+				ob_uint(o, y);
+				ob_putc(o, ')');
+				ob_putc(o, '\n');
+				if(x == ex && y == ey){
+					break;
+				}
+				path_step(&x, &y);
+			}
+			break;
+		case PF_RLE:
+			ob_uint(o, x);
+			ob_putc(o, ' ');
+			ob_uint(o, y);
+			while(x != ex || y != ey){
+				d = path_step(&x, &y);
+				if(d != ld && run){
+					ob_putc(o, ' ');
+					ob_putc(o, dc[ld]);
+					ob_uint(o, run);
+					run = 0;
+				}
+				ld = d;
+				run++;
+			}
+			if(run){
+				ob_putc(o, ' ');
+				ob_putc(o, dc[ld]);
+				ob_uint(o, run);
+			}
+			ob_putc(o, '\n');
+			break;
+		case PF_BIN:
+			// The header needs the number of steps first.
+			while(x != ex || y != ey){
+				path_step(&x, &y);
+				steps++;
+			}
+			for(k = 0; k < 4; k++){
+				ob_putc(o, MAZP_MAGIC[k]);
+			}
+			ob_le(o, MAZP_VERSION, 4);
+			ob_le(o, sx, 4);
+			ob_le(o, sy, 4);
+			ob_le(o, ex, 4);
+			ob_le(o, ey, 4);
+			ob_le(o, steps, 8);
+			x = sx;
+			y = sy;
+			for(steps = 0; x != ex || y != ey; steps++){
+				acc |= path_step(&x, &y) << (2 * (steps & 3));
+				if((steps & 3) == 3){
+					ob_putc(o, acc);
+					acc = 0;
+				}
+			}
+			if(steps & 3){
+				ob_putc(o, acc);
+			}
+			break;
+	}
+	ob_flush(o);
+	free(o);
+}
+
+// Writes the path with print_solution() to pfn, or where it goes by default.
+void write_solution(void){
+	if(pfn == NULL && plen > 100){
+		pfn = "solution.txt";
+		fprintf(stderr, "The solution is longer than I want to print to stdout.\n"
+		                "  You may find it in %s\n", pfn);
+	}
+	if(pfn == NULL || !strcmp(pfn, "-")){
+		print_solution(sx, sy, ex, ey, stdout);
+	} else {
+		FILE *sf = fopen(pfn, "w");
+		if(sf == NULL){
+			fprintf(stderr, "fopen() on %s failed (%m).\n", pfn);
+		} else {
+			print_solution(sx, sy, ex, ey, sf);
+			if(fclose(sf)){
+				fprintf(stderr, "Writing %s failed (%m).\n", pfn);
+			}
+		}
+	}
+}
+
+// Colours of the image: unvisited, open, closed, path and wall.
+static const unsigned char icol[5][3] = {
+	{255, 255, 255}, { 90, 200,  90}, {150, 180, 230}, {220,  30,  30}, {  0,   0,   0}};
+
+static inline int cell_colour(int x, int y){
+	int st = node_state(x, y);
+	return st & 4 ? 3 : st & 2 ? 2 : st & 1 ? 1 : 0;
+}
+
+// The colour of the opening between two cells: that of the path if both
+// are on it, otherwise that of the one further from it.
+static inline int gap_colour(int a, int b){
+	if(a == 3 && b == 3){
+		return 3;
+	}
+	return a == 3 ? b : b == 3 ? a : a < b ? a : b;
+}
+
+// Draws pixel rows [r0, r1) of the image.
+static void *render_band(void *arg){
+	band *b = arg;
+	unsigned char *p;
+	unsigned long long int sum[3], w, tw;
+	int py, px, x, y, x0, y0, x1, y1, c, k, path;
+	for(py = b->r0; py < b->r1; py++){
+		p = fb + (size_t) py * fbw * 3;
+		if(iscale == 1){
+			y = py >> 1;
+			for(px = 0; px < (int) fbw; px++){
+				x = px >> 1;
+				if(!(py & 1)){
+					c = !(px & 1) ? cell_colour(x, y) :
+					    node_neighbors(x, y) & 2 ? gap_colour(cell_colour(x, y), cell_colour(x + 1, y)) : 4;
+				} else {
+					c = !(px & 1) && node_neighbors(x, y) & 4 ?
+					    gap_colour(cell_colour(x, y), cell_colour(x, y + 1)) : 4;
+				}
+				memcpy(p + 3 * px, icol[c], 3);
+			}
+			continue;
+		}
+		y0 = py * iscale;
+		y1 = y0 + iscale < my ? y0 + iscale : my;
+		for(px = 0; px < (int) fbw; px++){
+			x0 = px * iscale;
+			x1 = x0 + iscale < mx ? x0 + iscale : mx;
+			sum[0] = sum[1] = sum[2] = 0;
+			tw = 0;
+			path = 0;
+			for(y = y0; y < y1; y++){
+				for(x = x0; x < x1; x++){
+					c = cell_colour(x, y);
+					path |= c == 3;
+					w = 1 + __builtin_popcount(node_neighbors(x, y));
+					for(k = 0; k < 3; k++){
+						sum[k] += w * icol[c][k];
+					}
+					tw += 5;
+				}
+			}
+			for(k = 0; k < 3; k++){
+				p[3 * px + k] = path ? icol[3][k] : sum[k] / tw;
+			}
 		}
 	}
-	fprintf(f, "(%d, %d)\n", x, y);
+	return NULL;
+}
+
+// Renders the maze and the last search into a PPM image in ifn, at iscale
+// cells per pixel, or if that is 0, at as few as keep it within 4096 pixels
+// wide and high.
+int render_image(char *ifn){
+	FILE *f;
+	int big = mx > my ? mx : my;
+	if(!iscale){
+		iscale = big <= 2048 ? 1 : big <= 8192 ? 2 : (big + 4095) / 4096;
+	}
+	if(iscale == 1){
+		fbw = 2 * (size_t) mx - 1;
+		fbh = 2 * (size_t) my - 1;
+	} else {
+		fbw = ((size_t) mx + iscale - 1) / iscale;
+		fbh = ((size_t) my + iscale - 1) / iscale;
+	}
+	if(iscale == 1){
+		fprintf(stderr, "Rendering a %llu x %llu image, 2 x 2 pixels per cell (%d threads)...\n",
+		        (unsigned long long int) fbw, (unsigned long long int) fbh, nthreads);
+	} else {
+		fprintf(stderr, "Rendering a %llu x %llu image, %d x %d cells per pixel (%d threads)...\n",
+		        (unsigned long long int) fbw, (unsigned long long int) fbh,
+		        iscale, iscale, nthreads);
+	}
+	fb = malloc(fbw * fbh * 3);
+	if(fb == NULL){
+		fprintf(stderr, "Framebuffer malloc() failed.\n");
+		return 1;
+	}
+	if(run_bands(fbh, render_band, NULL)){
+		free(fb);
+		return 1;
+	}
+	f = fopen(ifn, "w");
+	if(f == NULL){
+		fprintf(stderr, "fopen() on %s failed (%m).\n", ifn);
+		free(fb);
+		return 1;
+	}
+	fprintf(f, "P6\n%llu %llu\n255\n", (unsigned long long int) fbw, (unsigned long long int) fbh);
+	fwrite(fb, 3, fbw * fbh, f);
+	free(fb);
+	if(ferror(f) | fclose(f)){
+		fprintf(stderr, "Writing %s failed.\n", ifn);
+		return 1;
+	}
+	return 0;
 }
 
 void print_maze(void){
@@ -742,16 +6624,16 @@ void print_maze(void){
 	int i, j;
 	for(i = 0; i < my; i++){
 		for(j = 0; j < mx; j++){
-			printf("%s", reprs[(int) m[i][j].neighbors]);
+			printf("%s", reprs[node_neighbors(j, i)]);
 		}
 		printf("\n");
 	}
 }
 
-int check_heapness(void){
+int check_heapness(openlist *ol){
 	int i;
-	for(i = 0; i < nh; i++){
-		if(ohf[i] < ohf[(i - 1) / 2]){
+	for(i = 0; i < ol->nh; i++){
+		if(ol->ohf[i] < ol->ohf[(i - 1) / 2]){
 			return 1;
 		}
 	}
@@ -759,9 +6641,373 @@ int check_heapness(void){
 }
 
 void print_help(void){
-	fprintf(stderr, "Usage: ./solvemaze FILE [START_X] [START_Y] [END_X] [END_Y]\n"
-	                "\tFILE can be - to read from stdin.\n"
+	fprintf(stderr, "Usage: ./solvemaze [OPTIONS] FILE [START_X] [START_Y] [END_X] [END_Y]\n"
+	                "\tFILE can be - to read from stdin, and can be compressed\n"
+	                "\twith gzip or, if built with ZSTD=1, zstd.\n"
 	                "\tLeaving the starting and ending coordinates out will\n"
 	                "\tautomatically choose the bottom left and top right\n"
-	                "\tcorners, respectively.\n");
+	                "\tcorners, respectively.\n"
+	                "Options:\n"
+	                "\t-q, --queue=ENGINE  open list: bucket (default with an\n"
+	                "\t                    integral heuristic) or heap.\n"
+	                "\t-b, --bidirectional search from both ends at once.\n"
+	                "\t-Q, --queries=QFILE answer every \"START_X START_Y END_X END_Y\"\n"
+	                "\t                    line of QFILE (- for stdin) against the\n"
+	                "\t                    maze, printing \"START_X START_Y END_X END_Y\n"
+	                "\t                    LENGTH EXPANSIONS SECONDS\" for each.\n"
+	                "\t-j, --threads=N     use N threads for parsing, and workers\n"
+	                "\t                    for -U (default: one per online CPU).\n"
+	                "\t-c, --compact       keep the grid in 1.5 rather than %d bytes\n"
+	                "\t                    per cell, at the cost of clearing it for\n"
+	                "\t                    every search. Not with -b.\n"
+	                "\t-d, --dead-ends     fill in dead ends before searching, so\n"
+	                "\t                    the search and the drawing only see the\n"
+	                "\t                    corridors that remain. Not with -Q.\n"
+	                "\t-G, --contract[=GFILE]\n"
+	                "\t                    search the graph of junctions and dead\n"
+	                "\t                    ends joined by corridors rather than\n"
+	                "\t                    the grid. With GFILE, the graph is\n"
+	                "\t                    read from it if it was made from this\n"
+	                "\t                    maze file, and saved to it otherwise.\n"
+	                "\t                    Uses the heap; not with -c or -b.\n"
+	                "\t-H, --hpa           search an HPA* abstraction of %d x %d\n"
+	                "\t                    cell clusters, kept in FILE.hpa for\n"
+	                "\t                    later runs. Uses the heap; not with -c,\n"
+	                "\t                    -b, -G or -d.\n"
+	                "\t-B, --bitboard      breadth-first search 64 cells at a time\n"
+	                "\t                    on bitboards of the openings.\n"
+	                "\t-R, --reachable     only find out whether there is a path,\n"
+	                "\t                    by flooding the bitboards. Queries print\n"
+	                "\t                    reachable or unreachable for LENGTH.\n"
+	                "\t                    Neither goes with -b, -G or -H.\n"
+	                "\t-F, --distance-field=DFILE\n"
+	                "\t                    write the distance of every cell from\n"
+	                "\t                    the end, and the direction towards it,\n"
+	                "\t                    to DFILE instead of solving. Uses -j\n"
+	                "\t                    threads; goes with no other mode.\n"
+	                "\t-P, --parse-bench[=N]\n"
+	                "\t                    parse the text maze N times (default 5)\n"
+	                "\t                    with each of the scalar, SSE2 and AVX2\n"
+	                "\t                    parsers the CPU can run, print the best\n"
+	                "\t                    bandwidth of each and exit.\n"
+	                "\t-S, --stats=FORMAT  report the statistics at the end as text\n"
+	                "\t                    (default) or as a line of json on stderr.\n"
+	                "\t-E, --perf          count cycles, instructions, cache and dTLB\n"
+	                "\t                    misses in each phase with perf_event_open.\n"
+	                "\t-o, --output=PFILE  write the path to PFILE (- for stdout)\n"
+	                "\t                    rather than to stdout, or to solution.txt\n"
+	                "\t                    if it is longer than 100 steps.\n"
+	                "\t-f, --format=FORMAT write the path as coords, a line \"(x, y)\"\n"
+	                "\t                    per cell (default), as rle, the start and\n"
+	                "\t                    runs of steps like \"R12 U3 L7\", or as bin,\n"
+	                "\t                    2 bits per step after a MAZP header\n"
+	                "\t                    (needs -o).\n"
+	                "\t-I, --image=IFILE   draw the maze, the path and the closed and\n"
+	                "\t                    open nodes into a PPM image in IFILE.\n"
+	                "\t-Z, --image-scale=N draw N x N cells per pixel, or with N = 1\n"
+	                "\t                    each cell and its walls in 2 x 2 pixels\n"
+	                "\t                    (default: within 4096 pixels).\n", (int) sizeof(node), HC, HC);
+	fprintf(stderr, "\t-U, --serve=SOCKET  load every FILE given and answer queries\n"
+	                "\t                    about them on the Unix socket SOCKET\n"
+	                "\t                    until interrupted, a line per request:\n"
+	                "\t                    \"[MAZE] START_X START_Y END_X END_Y\"\n"
+	                "\t                    as with -Q, \"path ...\" for the steps\n"
+	                "\t                    as well, \"mazes\" or \"stats\". MAZE is\n"
+	                "\t                    the index of a FILE, 0 by default.\n"
+	                "\t-W, --edits=EFILE   after solving, open and close the walls\n"
+	                "\t                    of the \"X Y DIR open|close\" lines of\n"
+	                "\t                    EFILE (- for stdin), DIR one of U, R, D\n"
+	                "\t                    and L, repairing the path with LPA* at\n"
+	                "\t                    each \"solve\" line and at the end, and\n"
+	                "\t                    print \"BATCH EDITS LENGTH REPAIRED\n"
+	                "\t                    SECONDS\" for each, with the expansions\n"
+	                "\t                    of the repair. The path written is the\n"
+	                "\t                    last repaired one. Not with -Q, -c, -b,\n"
+	                "\t                    -d, -G, -H, -B, -R or -F.\n"
+	                "\t-V, --verify        with -W, also solve every batch from\n"
+	                "\t                    scratch, failing if the lengths differ,\n"
+	                "\t                    and print \"BATCH EDITS LENGTH REPAIRED\n"
+	                "\t                    FULL REPAIR_SECONDS FULL_SECONDS\".\n"
+	                "\t-X, --external=DIR  solve out of core, for mazes too big for\n"
+	                "\t                    memory: the maze is copied into tiles in\n"
+	                "\t                    a scratch file in DIR, read back through\n"
+	                "\t                    a cache, and searched breadth-first with\n"
+	                "\t                    its levels kept on disk as sorted runs.\n"
+	                "\t                    DIR needs half a byte per cell, and 8\n"
+	                "\t                    bytes per cell the search reaches. Goes\n"
+	                "\t                    with no other mode, nor with -I.\n"
+	                "\t-K, --memory=MIB    memory for the tile cache and the sorting\n"
+	                "\t                    of -X (default: 256).\n");
+}
+
+int ol_init(openlist *ol, int engine, int closed, int lazy){
+	int k;
+	memset(ol, 0, sizeof(openlist));
+	ol->engine = engine;
+	ol->closed = closed;
+	ol->lazy   = lazy || engine == OL_BUCKET;
+	if(engine == OL_HEAP){
+		ol->ah  = HRI;
+		ol->ohx = malloc(ol->ah * sizeof(int));
+		ol->ohy = malloc(ol->ah * sizeof(int));
+		ol->ohf = malloc(ol->ah * sizeof(h_t));
+		if(ol->ohx == NULL || ol->ohy == NULL || ol->ohf == NULL){
+			fprintf(stderr, "Heap malloc() failed.\n");
+			return 1;
+		}
+	} else {
+		for(k = 0; k < BQR; k++){
+			ol->ab[k] = HRI;
+			ol->bx[k] = malloc(ol->ab[k] * sizeof(int));
+			ol->by[k] = malloc(ol->ab[k] * sizeof(int));
+			if(ol->bx[k] == NULL || ol->by[k] == NULL){
+				fprintf(stderr, "Bucket malloc() failed.\n");
+				return 1;
+			}
+		}
+		ol->bf = -1;
+	}
+	return 0;
+}
+
+// Empties an open list for a new search, keeping its allocations.
+void ol_clear(openlist *ol){
+	int k;
+	ol->nh = 0;
+	for(k = 0; k < BQR; k++){
+		ol->nb[k] = 0;
+	}
+	ol->n  = 0;
+	ol->bf = -1;
+}
+
+void ol_free(openlist *ol){
+	int k;
+	free(ol->ohx);
+	free(ol->ohy);
+	free(ol->ohf);
+	for(k = 0; k < BQR; k++){
+		free(ol->bx[k]);
+		free(ol->by[k]);
+	}
+}
+
+// Sift the heap entry at hcur up towards the root.
+static void heap_up(openlist *ol, int hcur){
+	int hswap;
+	int tempx, tempy;
+	h_t tempf;
+	while(hcur > 0){
+		hswap = (hcur - 1) / 2;
+		if(ol->ohf[hswap] > ol->ohf[hcur]){
+			tempx           = ol->ohx[hcur];
+			tempy           = ol->ohy[hcur];
+			tempf           = ol->ohf[hcur];
+			ol->ohx[hcur ]  = ol->ohx[hswap];
+			ol->ohy[hcur ]  = ol->ohy[hswap];
+			ol->ohf[hcur ]  = ol->ohf[hswap];
+			ol->ohx[hswap]  = tempx;
+			ol->ohy[hswap]  = tempy;
+			ol->ohf[hswap]  = tempf;
+			if(!ol->lazy){
+				NODE(ol->ohx[hcur ], ol->ohy[hcur ]).hindex = hcur;
+				NODE(ol->ohx[hswap], ol->ohy[hswap]).hindex = hswap;
+			}
+			hcur = hswap;
+			hswaps++;
+		} else {
+			break;
+		}
+	}
+}
+
+// Sift the root of the heap down to where it belongs.
+static void heap_down(openlist *ol){
+	int hcur;
+	int hchild;
+	int hswap;
+	int tempx, tempy;
+	h_t tempf;
+	hcur = 0;
+	while(2 * hcur + 1 < ol->nh){
+		hchild = 2 * hcur + 1;
+		hswap = hcur;
+		if(ol->ohf[hswap] > ol->ohf[hchild]){
+			hswap = hchild;
+		}
+		if(hchild + 1 < ol->nh && ol->ohf[hswap] > ol->ohf[hchild + 1]){
+			hswap = hchild + 1;
+		}
+		if(hswap != hcur){
+			tempx          = ol->ohx[hcur];
+			tempy          = ol->ohy[hcur];
+			tempf          = ol->ohf[hcur];
+			ol->ohx[hcur ] = ol->ohx[hswap];
+			ol->ohy[hcur ] = ol->ohy[hswap];
+			ol->ohf[hcur ] = ol->ohf[hswap];
+			ol->ohx[hswap] = tempx;
+			ol->ohy[hswap] = tempy;
+			ol->ohf[hswap] = tempf;
+			if(!ol->lazy){
+				NODE(ol->ohx[hcur ], ol->ohy[hcur ]).hindex = hcur;
+				NODE(ol->ohx[hswap], ol->ohy[hswap]).hindex = hswap;
+			}
+			hcur = hswap;
+			hswaps++;
+		} else {
+			break;
+		}
+	}
+}
+
+int ol_push(openlist *ol, int x, int y, h_t f){
+	int k;
+	qpushes++;
+	if(ol->engine == OL_HEAP){
+		if(ol->nh == ol->ah){
+			/*if(check_heapness(ol)){
+				fprintf(stderr, "HEAPFAIL\n");
+			} else {
+				fprintf(stderr, "heappass\n");
+			}*/
+			ol->ah *= 2;
+			qgrows++;
+			fprintf(stderr, "Expanding heap to %d nodes, %llu swaps so far.\n", ol->ah, hswaps);
+			ol->ohx = realloc(ol->ohx, ol->ah * sizeof(int));
+			ol->ohy = realloc(ol->ohy, ol->ah * sizeof(int));
+			ol->ohf = realloc(ol->ohf, ol->ah * sizeof(h_t));
+			if(ol->ohx == NULL || ol->ohy == NULL || ol->ohf == NULL){
+				fprintf(stderr, "Heap realloc failed.\n");
+				return 1;
+			}
+		}
+		ol->ohx[ol->nh] = x;
+		ol->ohy[ol->nh] = y;
+		ol->ohf[ol->nh] = f;
+		if(!ol->lazy){
+			NODE(x, y).hindex = ol->nh;
+		}
+		heap_up(ol, ol->nh++);
+		if((unsigned long long int) ol->nh > qpeak){
+			qpeak = ol->nh;
+		}
+		return 0;
+	}
+	if(ol->bf < 0){
+		ol->bf = f;
+	}
+	if(f < ol->bf || f - ol->bf >= BQR){
+		fprintf(stderr, "f-score %d is outside the bucket ring [%d, %d); "
+		                "the heuristic is not consistent.\n", (int) f, ol->bf, ol->bf + BQR);
+		return 1;
+	}
+	k = (int) f & (BQR - 1);
+	if(ol->nb[k] == ol->ab[k]){
+		ol->ab[k] *= 2;
+		qgrows++;
+		ol->bx[k] = realloc(ol->bx[k], ol->ab[k] * sizeof(int));
+		ol->by[k] = realloc(ol->by[k], ol->ab[k] * sizeof(int));
+		if(ol->bx[k] == NULL || ol->by[k] == NULL){
+			fprintf(stderr, "Bucket realloc failed.\n");
+			return 1;
+		}
+	}
+	ol->bx[k][ol->nb[k]] = x;
+	ol->by[k][ol->nb[k]] = y;
+	ol->nb[k]++;
+	ol->n++;
+	if((unsigned long long int) ol->n > qpeak){
+		qpeak = ol->n;
+	}
+	return 0;
+}
+
+int ol_decrease(openlist *ol, int x, int y, h_t f){
+	if(!ol->lazy){
+		int hcur = NODE(x, y).hindex;
+		ol->ohf[hcur] = f;
+		heap_up(ol, hcur);
+		return 0;
+	}
+	return ol_push(ol, x, y, f);
+}
+
+int ol_pop(openlist *ol, int *x, int *y){
+	if(ol->engine == OL_HEAP){
+		while(ol->nh){
+			*x = ol->ohx[0];
+			*y = ol->ohy[0];
+			ol->pf = ol->ohf[0];
+			
+			// Remove the root from the heap, replace it with the last node.
+			ol->nh--;
+			ol->ohx[0] = ol->ohx[ol->nh];
+			ol->ohy[0] = ol->ohy[ol->nh];
+			ol->ohf[0] = ol->ohf[ol->nh];
+			if(!ol->lazy){
+				NODE(ol->ohx[0], ol->ohy[0]).hindex = 0;
+			}
+			heap_down(ol);
+			
+			if(ol->lazy && is_closed(ol, *x, *y)){
+				qstale++;
+				continue;
+			}
+			return 1;
+		}
+		return 0;
+	}
+	int k;
+	while(ol->n){
+		k = ol->bf & (BQR - 1);
+		if(!ol->nb[k]){
+			ol->bf++;
+			continue;
+		}
+		ol->n--;
+		ol->nb[k]--;
+		*x = ol->bx[k][ol->nb[k]];
+		*y = ol->by[k][ol->nb[k]];
+		ol->pf = ol->bf;
+		if(is_closed(ol, *x, *y)){
+			qstale++;
+			continue;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+// Returns a lower bound on the f-score of the best open node: exact for a
+// heap, the current bucket for a bucket queue (which may only hold stale
+// entries). An empty open list has no bound at all.
+h_t ol_peek(openlist *ol){
+	if(ol->engine == OL_HEAP){
+		return ol->nh ? ol->ohf[0] : INT_MAX;
+	}
+	if(!ol->n){
+		return INT_MAX;
+	}
+	while(!ol->nb[ol->bf & (BQR - 1)]){
+		ol->bf++;
+	}
+	return ol->bf;
+}
+
+long long int ol_size(openlist *ol){
+	return ol->engine == OL_HEAP ? ol->nh : ol->n;
+}
+
+// Bytes allocated for an open list's entries. They only ever grow, so this
+// is also their high-water mark.
+unsigned long long int ol_bytes(openlist *ol){
+	unsigned long long int b = 0;
+	int k;
+	if(ol->engine == OL_HEAP){
+		return (unsigned long long int) ol->ah * (2 * sizeof(int) + sizeof(h_t));
+	}
+	for(k = 0; k < BQR; k++){
+		b += (unsigned long long int) ol->ab[k] * 2 * sizeof(int);
+	}
+	return b;
 }